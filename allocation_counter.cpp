@@ -0,0 +1,134 @@
+#include "allocation_counter.h"
+
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace {
+// trivial type, so it needs no initialization at thread start and may be used by operator new at any time
+thread_local size_t allocation_count = 0;
+
+void* Allocate(size_t size) noexcept {
+    ++allocation_count;
+    return std::malloc(size > 0 ? size : 1);
+}
+
+void* AllocateAligned(size_t size, std::align_val_t alignment) noexcept {
+    ++allocation_count;
+    const size_t align = static_cast<size_t>(alignment) > sizeof(void*) ? static_cast<size_t>(alignment) : sizeof(void*);
+    // size of aligned_alloc must be a multiple of alignment
+    const size_t aligned_size = size > 0 ? (size + align - 1) / align * align : align;
+#ifdef _WIN32
+    return _aligned_malloc(aligned_size, align);
+#else
+    return std::aligned_alloc(align, aligned_size);
+#endif
+}
+
+void FreeAligned(void* data) noexcept {
+#ifdef _WIN32
+    _aligned_free(data);
+#else
+    std::free(data);
+#endif
+}
+}
+
+size_t GetAllocationCount() {
+    return allocation_count;
+}
+
+void* operator new(size_t size) {
+    if (void* data = Allocate(size)) {
+        return data;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    if (void* data = Allocate(size)) {
+        return data;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return Allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return Allocate(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    if (void* data = AllocateAligned(size, alignment)) {
+        return data;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+    if (void* data = AllocateAligned(size, alignment)) {
+        return data;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return AllocateAligned(size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return AllocateAligned(size, alignment);
+}
+
+void operator delete(void* data) noexcept {
+    std::free(data);
+}
+
+void operator delete[](void* data) noexcept {
+    std::free(data);
+}
+
+void operator delete(void* data, size_t) noexcept {
+    std::free(data);
+}
+
+void operator delete[](void* data, size_t) noexcept {
+    std::free(data);
+}
+
+void operator delete(void* data, const std::nothrow_t&) noexcept {
+    std::free(data);
+}
+
+void operator delete[](void* data, const std::nothrow_t&) noexcept {
+    std::free(data);
+}
+
+void operator delete(void* data, std::align_val_t) noexcept {
+    FreeAligned(data);
+}
+
+void operator delete[](void* data, std::align_val_t) noexcept {
+    FreeAligned(data);
+}
+
+void operator delete(void* data, size_t, std::align_val_t) noexcept {
+    FreeAligned(data);
+}
+
+void operator delete[](void* data, size_t, std::align_val_t) noexcept {
+    FreeAligned(data);
+}
+
+void operator delete(void* data, std::align_val_t, const std::nothrow_t&) noexcept {
+    FreeAligned(data);
+}
+
+void operator delete[](void* data, std::align_val_t, const std::nothrow_t&) noexcept {
+    FreeAligned(data);
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <cstddef>
+
+// operators new and delete of the program are replaced to count allocations for benchmarks,
+// every thread counts its own, so allocating threads don't contend on one counter
+size_t GetAllocationCount();
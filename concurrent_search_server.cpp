@@ -0,0 +1,30 @@
+#include "concurrent_search_server.h"
+
+#include <utility>
+
+ConcurrentSearchServer::ConcurrentSearchServer(SearchServer search_server)
+    : current_(std::make_shared<const SearchServer>(std::move(search_server)))
+{
+}
+
+std::shared_ptr<const SearchServer> ConcurrentSearchServer::GetSnapshot() const {
+    return std::atomic_load(&current_);
+}
+
+void ConcurrentSearchServer::AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings) {
+    Update([&](SearchServer& search_server) {
+        search_server.AddDocument(document_id, document, status, ratings);
+    });
+}
+
+void ConcurrentSearchServer::AddDocuments(const std::vector<DocumentToAdd>& documents) {
+    Update([&documents](SearchServer& search_server) {
+        search_server.AddDocuments(documents);
+    });
+}
+
+void ConcurrentSearchServer::RemoveDocuments(const std::vector<int>& document_ids) {
+    Update([&document_ids](SearchServer& search_server) {
+        search_server.RemoveDocuments(document_ids);
+    });
+}
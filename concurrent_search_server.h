@@ -0,0 +1,45 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#include "document.h"
+#include "search_server.h"
+
+// SearchServer for readers and writers working at the same time (read-copy-update).
+// Readers take the current version and search it without locks, it is never changed.
+// Writers are serialized: every change is applied to a copy of the current version,
+// which replaces it atomically. Old version is freed by the last reader holding it.
+// Sealed segments of index, words, word frequencies and positions of documents are shared by versions.
+// Per-document arrays and id maps are still copied, so every update costs a copy of them
+// and documents should be added by batches.
+class ConcurrentSearchServer {
+public:
+    explicit ConcurrentSearchServer(SearchServer search_server);
+
+    // version to search, it stays valid while the pointer is held
+    std::shared_ptr<const SearchServer> GetSnapshot() const;
+
+    void AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    void AddDocuments(const std::vector<DocumentToAdd>& documents);
+    void RemoveDocuments(const std::vector<int>& document_ids);
+    // updater(SearchServer&) makes any changes of one new version,
+    // nothing is published if it throws
+    template <typename Updater>
+    void Update(Updater updater);
+
+private:
+    std::shared_ptr<const SearchServer> current_;
+    std::mutex update_mutex_;
+};
+
+template <typename Updater>
+void ConcurrentSearchServer::Update(Updater updater) {
+    std::lock_guard guard(update_mutex_);
+    // only writers replace current_, so it is read without atomic_load under the lock
+    auto next = std::make_shared<SearchServer>(*current_);
+    updater(*next);
+    std::atomic_store(&current_, std::shared_ptr<const SearchServer>(std::move(next)));
+}
@@ -0,0 +1,883 @@
+#include "inverted_index.h"
+#include "varint.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+    // count postings following previous_ordinal
+    void DecodeVarints(const uint8_t* data, int previous_ordinal, size_t count, int* ordinals, uint32_t* term_counts) {
+        int ordinal = previous_ordinal;
+        for (size_t i = 0; i < count; ++i) {
+            ordinal += static_cast<int>(ReadVarint(data));
+            ordinals[i] = ordinal;
+            term_counts[i] = ReadVarint(data);
+        }
+    }
+
+    int GetBitWidth(const uint32_t* values, size_t count) {
+        uint32_t all_bits = 0;
+        for (size_t i = 0; i < count; ++i) {
+            all_bits |= values[i];
+        }
+        // shift of uint32_t by 32 is undefined
+        int bits = 0;
+        while (bits < 32 && all_bits >> bits) {
+            ++bits;
+        }
+        return bits;
+    }
+
+    // groups of 8 values take exactly bits bytes
+    size_t GetGroupCount(size_t count) {
+        return (count + 7) / 8;
+    }
+
+    // count values of bits width in little-endian bit order, the way UnpackBits reads them,
+    // the last group is padded with zeros
+    void PackBits(std::vector<uint8_t>& data, const uint32_t* values, size_t count, int bits) {
+        const size_t first = data.size();
+        data.resize(first + GetGroupCount(count) * bits, 0);
+        for (size_t i = 0, bit_position = 0; i < count; ++i, bit_position += bits) {
+            for (uint64_t value = values[i], position = bit_position; value != 0;) {
+                data[first + position / 8] |= static_cast<uint8_t>(value << (position % 8));
+                const int written = 8 - position % 8;
+                value >>= written;
+                position += written;
+            }
+        }
+    }
+
+    // every value is taken by one unaligned 8-byte load, so data must have 7 readable bytes after the end.
+    // Width is a template parameter, so shifts and offsets are constants
+    template <int Bits>
+    void UnpackGroup(const uint8_t* data, uint32_t* values) {
+        constexpr uint64_t mask = (uint64_t{ 1 } << Bits) - 1;
+        for (size_t i = 0; i < 8; ++i) {
+            uint64_t word;
+            std::memcpy(&word, data + i * Bits / 8, sizeof(word));
+            values[i] = static_cast<uint32_t>((word >> (i * Bits % 8)) & mask);
+        }
+    }
+
+    template <int Bits>
+    void UnpackBits(const uint8_t* data, size_t group_count, uint32_t* values) {
+        if constexpr (Bits == 0) {
+            std::fill_n(values, group_count * 8, 0);
+        }
+        else if (group_count == InvertedIndex::BLOCK_SIZE / 8) {
+            // full blocks are the most, the loop with constant bounds is unrolled
+            for (size_t group = 0; group < InvertedIndex::BLOCK_SIZE / 8; ++group) {
+                UnpackGroup<Bits>(data + group * Bits, values + group * 8);
+            }
+        }
+        else {
+            for (size_t group = 0; group < group_count; ++group) {
+                UnpackGroup<Bits>(data + group * Bits, values + group * 8);
+            }
+        }
+    }
+
+    template <int... Bits>
+    void UnpackBits(const uint8_t* data, int bits, size_t group_count, uint32_t* values, std::integer_sequence<int, Bits...>) {
+        using Unpacker = void (*)(const uint8_t*, size_t, uint32_t*);
+        static constexpr Unpacker unpackers[] = { &UnpackBits<Bits>... };
+        unpackers[bits](data, group_count, values);
+    }
+
+    void UnpackBits(const uint8_t* data, int bits, size_t group_count, uint32_t* values) {
+        UnpackBits(data, bits, group_count, values, std::make_integer_sequence<int, 33>());
+    }
+
+    void MergeBounds(InvertedIndex::ScoreBounds& bounds, const InvertedIndex::ScoreBounds& other) {
+        bounds.max_term_freq = std::max(bounds.max_term_freq, other.max_term_freq);
+        bounds.max_term_count = std::max(bounds.max_term_count, other.max_term_count);
+        bounds.min_document_length = std::min(bounds.min_document_length, other.min_document_length);
+    }
+
+    bool IsEqual(const InvertedIndex::ScoreBounds& bounds, const InvertedIndex::ScoreBounds& other) {
+        return bounds.max_term_freq == other.max_term_freq && bounds.max_term_count == other.max_term_count &&
+            bounds.min_document_length == other.min_document_length;
+    }
+}
+
+InvertedIndex::PostingIterator::PostingIterator(const InvertedIndex& index, int term_id, int first_ordinal)
+    : index_(&index)
+    , term_id_(term_id)
+    , is_removed_(index.removed_count_ > 0 ? index.is_removed_.data() : nullptr)
+{
+    if (OpenSegment(0, first_ordinal)) {
+        Seek(first_ordinal);
+    }
+}
+
+bool InvertedIndex::PostingIterator::OpenSegment(size_t segment, int min_ordinal) {
+    // segments are in order of ordinals, the buffer is the last one
+    for (; segment <= index_->segments_.size(); ++segment) {
+        const Segment& source = index_->GetSegment(segment);
+        if (source.GetEndOrdinal() <= min_ordinal) {
+            continue;
+        }
+        if (const PostingList* postings = index_->FindPostings(segment, term_id_)) {
+            segment_ = segment;
+            postings_ = postings;
+            first_ordinal_ = source.first_ordinal;
+            inverse_document_lengths_ = source.inverse_document_lengths.data();
+            document_lengths_ = source.document_lengths.data();
+            block_ = 0;
+            decoded_block_ = postings->GetBlockCount();
+            return true;
+        }
+    }
+    segment_ = index_->segments_.size() + 1;
+    postings_ = nullptr;
+    position_ = decoded_size_ = 0;
+    return false;
+}
+
+void InvertedIndex::PostingIterator::NextBlock() {
+    do {
+        if (++block_ == postings_->GetBlockCount() && !OpenSegment(segment_ + 1, 0)) {
+            return;
+        }
+        DecodeBlock();
+    } while (decoded_size_ == 0);
+}
+
+bool InvertedIndex::PostingIterator::SeekBlock(int ordinal) {
+    if (postings_ == nullptr) {
+        return false;
+    }
+    while (true) {
+        const Block* blocks = postings_->GetBlocks();
+        const size_t block_count = postings_->GetBlockCount();
+        if (block_ < block_count && blocks[block_].last_ordinal < ordinal) {
+            // galloping: steps double until a block reaches ordinal, then binary search between the last two,
+            // so long jumps of conjunctive queries cost log of distance and short ones stay short
+            size_t low = block_;
+            size_t step = 1;
+            while (low + step < block_count && blocks[low + step].last_ordinal < ordinal) {
+                low += step;
+                step *= 2;
+            }
+            const size_t high = std::min(low + step, block_count);
+            block_ = std::partition_point(blocks + low + 1, blocks + high,
+                [ordinal](const Block& block) { return block.last_ordinal < ordinal; }) - blocks;
+        }
+        if (block_ < block_count) {
+            return true;
+        }
+        if (!OpenSegment(segment_ + 1, ordinal)) {
+            return false;
+        }
+    }
+}
+
+bool InvertedIndex::PostingIterator::Seek(int ordinal) {
+    while (SeekBlock(ordinal)) {
+        if (decoded_block_ != block_) {
+            DecodeBlock();
+        }
+        while (position_ < decoded_size_ && ordinals_[position_] < ordinal) {
+            ++position_;
+        }
+        if (position_ < decoded_size_) {
+            return ordinals_[position_] == ordinal;
+        }
+        // the rest of block is removed, the next one starts after ordinal
+        ++block_;
+    }
+    return false;
+}
+
+void InvertedIndex::PostingIterator::DecodeBlock() {
+    decoded_size_ = InvertedIndex::DecodeBlock(*postings_, block_, ordinals_, term_counts_);
+    if (is_removed_ != nullptr) {
+        size_t kept = 0;
+        for (size_t i = 0; i < decoded_size_; ++i) {
+            ordinals_[kept] = ordinals_[i];
+            term_counts_[kept] = term_counts_[i];
+            kept += is_removed_[ordinals_[i]] == 0;
+        }
+        decoded_size_ = kept;
+    }
+    for (size_t i = 0; i < decoded_size_; ++i) {
+        term_freqs_[i] = term_counts_[i] * inverse_document_lengths_[ordinals_[i] - first_ordinal_];
+    }
+    decoded_block_ = block_;
+    position_ = 0;
+}
+
+const uint8_t* InvertedIndex::PostingList::GetData() const {
+    return mapped_data != nullptr ? mapped_data : data.data();
+}
+
+size_t InvertedIndex::PostingList::GetDataSize() const {
+    return mapped_data != nullptr ? mapped_data_size : data.size();
+}
+
+const InvertedIndex::Block* InvertedIndex::PostingList::GetBlocks() const {
+    return mapped_blocks != nullptr ? mapped_blocks : blocks.data();
+}
+
+const InvertedIndex::ScoreBounds* InvertedIndex::PostingList::GetBlockBounds() const {
+    return mapped_block_bounds != nullptr ? mapped_block_bounds : block_bounds.data();
+}
+
+size_t InvertedIndex::PostingList::GetBlockCount() const {
+    return (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+}
+
+int InvertedIndex::Segment::GetEndOrdinal() const {
+    return first_ordinal + static_cast<int>(document_lengths.size());
+}
+
+const InvertedIndex::PostingList* InvertedIndex::Segment::FindPostings(int term_id) const {
+    const auto it = std::lower_bound(term_ids.begin(), term_ids.end(), term_id);
+    return it != term_ids.end() && *it == term_id ? &postings[it - term_ids.begin()] : nullptr;
+}
+
+int InvertedIndex::FindTerm(const std::string_view word) const {
+    return terms_.Find(word);
+}
+
+int InvertedIndex::AddTerm(const std::string_view word) {
+    const int term_id = terms_.Add(word);
+    if (static_cast<size_t>(term_id) == document_freqs_.size()) {
+        document_freqs_.push_back(0);
+        buffer_postings_.emplace_back();
+    }
+    return term_id;
+}
+
+void InvertedIndex::RemoveTerm(int term_id) {
+    terms_.Remove(term_id);
+    buffer_postings_[term_id] = PostingList();
+}
+
+void InvertedIndex::CompactTerms() {
+    terms_.Compact();
+}
+
+void InvertedIndex::SetDocumentLength(int document_ordinal, int word_count) {
+    buffer_.document_lengths.push_back(word_count);
+    buffer_.inverse_document_lengths.push_back(word_count > 0 ? 1.0 / word_count : 0.0);
+    is_removed_.resize(document_ordinal + 1, 0);
+    GrowLogarithms();
+}
+
+int InvertedIndex::GetDocumentLength(int document_ordinal) const {
+    const Segment& segment = GetSegment(FindSegment(document_ordinal));
+    return segment.document_lengths[document_ordinal - segment.first_ordinal];
+}
+
+void InvertedIndex::AddPosting(int term_id, int document_ordinal, uint32_t term_count) {
+    AppendPosting(buffer_, buffer_postings_[term_id], { document_ordinal, term_count });
+    ++document_freqs_[term_id];
+}
+
+void InvertedIndex::RemoveDocuments(const std::vector<int>& document_ordinals) {
+    for (const int ordinal : document_ordinals) {
+        if (is_removed_[ordinal]) {
+            continue;
+        }
+        is_removed_[ordinal] = 1;
+        ++removed_count_;
+        const size_t segment = FindSegment(ordinal);
+        ++(segment == segments_.size() ? buffer_removed_count_ : segment_removed_counts_[segment]);
+    }
+}
+
+void InvertedIndex::DecrementDocumentFreq(int term_id, size_t count) {
+    document_freqs_[term_id] -= count;
+}
+
+void InvertedIndex::Flush(bool force) {
+    if (buffer_.document_lengths.size() >= BUFFER_DOCUMENT_COUNT || (force && !buffer_.document_lengths.empty())) {
+        SealBuffer();
+    }
+    if (merge_.valid()) {
+        if (merge_.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return;
+        }
+        InstallMerge(merge_.get());
+        merge_ = {};
+    }
+    StartMerge();
+}
+
+void InvertedIndex::WaitMerges() {
+    while (merge_.valid()) {
+        InstallMerge(merge_.get());
+        merge_ = {};
+        StartMerge();
+    }
+}
+
+size_t InvertedIndex::GetSegmentCount() const {
+    return segments_.size();
+}
+
+bool InvertedIndex::NeedsCompaction() const {
+    return removed_count_ >= MIN_COMPACTED_COUNT && removed_count_ > is_removed_.size() - removed_count_;
+}
+
+std::vector<int> InvertedIndex::CompactOrdinals() {
+    // merge of old ordinals is not installed any more
+    merge_ = {};
+    if (!buffer_.document_lengths.empty()) {
+        SealBuffer();
+    }
+    std::vector<int> new_ordinals(is_removed_.size(), -1);
+    int document_count = 0;
+    for (size_t ordinal = 0; ordinal < is_removed_.size(); ++ordinal) {
+        if (!is_removed_[ordinal]) {
+            new_ordinals[ordinal] = document_count++;
+        }
+    }
+
+    std::vector<std::shared_ptr<const Segment>> segments;
+    for (const auto& source : segments_) {
+        auto segment = CompactSegment(*source, new_ordinals);
+        if (!segment->document_lengths.empty()) {
+            segments.push_back(std::move(segment));
+        }
+    }
+    segments_ = std::move(segments);
+    segment_removed_counts_.assign(segments_.size(), 0);
+    buffer_.first_ordinal = document_count;
+
+    // memory of dropped ordinals is released
+    is_removed_ = std::vector<char>(document_count, 0);
+    removed_count_ = 0;
+    logarithms_.resize(document_count + 2);
+    logarithms_.shrink_to_fit();
+    half_logarithms_.resize(document_count + 1);
+    half_logarithms_.shrink_to_fit();
+    StartMerge();
+    return new_ordinals;
+}
+
+InvertedIndex::PostingIterator InvertedIndex::GetPostings(int term_id, int first_ordinal) const {
+    return PostingIterator(*this, term_id, first_ordinal);
+}
+
+size_t InvertedIndex::GetDocumentFreq(int term_id) const {
+    return document_freqs_[term_id];
+}
+
+double InvertedIndex::GetInverseDocumentFreq(int term_id, size_t document_count) const {
+    return logarithms_[document_count] - logarithms_[document_freqs_[term_id]];
+}
+
+double InvertedIndex::GetSmoothedInverseDocumentFreq(int term_id, size_t document_count) const {
+    return logarithms_[document_count + 1] - half_logarithms_[document_freqs_[term_id]];
+}
+
+InvertedIndex::ScoreBounds InvertedIndex::GetScoreBounds(int term_id) const {
+    ScoreBounds bounds;
+    for (size_t segment = 0; segment <= segments_.size(); ++segment) {
+        if (const PostingList* postings = FindPostings(segment, term_id)) {
+            MergeBounds(bounds, postings->bounds);
+        }
+    }
+    return bounds;
+}
+
+std::string_view InvertedIndex::GetTerm(int term_id) const {
+    return terms_.GetWord(term_id);
+}
+
+int InvertedIndex::GetTermCount() const {
+    return terms_.GetSize();
+}
+
+const TermDictionary& InvertedIndex::GetTerms() const {
+    return terms_;
+}
+
+bool InvertedIndex::IsRemoved(int document_ordinal) const {
+    return is_removed_[document_ordinal] != 0;
+}
+
+void InvertedIndex::Save(SnapshotWriter& writer, const std::vector<int>& term_numbers) const {
+    writer.WriteArray(is_removed_);
+    std::vector<uint64_t> document_freqs(terms_.GetSize());
+    for (size_t term_id = 0; term_id < term_numbers.size(); ++term_id) {
+        if (term_numbers[term_id] >= 0) {
+            document_freqs[term_numbers[term_id]] = document_freqs_[term_id];
+        }
+    }
+    writer.WriteArray(document_freqs);
+
+    // lists of the buffer are copied and sealed, so loaded index starts with empty buffer
+    Segment buffer;
+    buffer.first_ordinal = buffer_.first_ordinal;
+    buffer.document_lengths = buffer_.document_lengths;
+    for (size_t term_id = 0; term_id < buffer_postings_.size(); ++term_id) {
+        if (buffer_postings_[term_id].size > 0) {
+            buffer.term_ids.push_back(static_cast<int>(term_id));
+            SealPostings(buffer.postings.emplace_back(buffer_postings_[term_id]));
+        }
+    }
+    const bool has_buffer = !buffer.document_lengths.empty();
+    writer.Write<uint64_t>(segments_.size() + has_buffer);
+    for (const auto& segment : segments_) {
+        SaveSegment(writer, *segment, term_numbers);
+    }
+    if (has_buffer) {
+        SaveSegment(writer, buffer, term_numbers);
+    }
+}
+
+void InvertedIndex::Load(SnapshotReader& reader, std::shared_ptr<const MappedFile> file, size_t document_count) {
+    const int term_count = terms_.GetIdLimit();
+    std::vector<uint64_t> document_freqs;
+    reader.ReadArray(is_removed_);
+    reader.ReadArray(document_freqs);
+    if ((is_removed_.size() != document_count) || (is_removed_.size() > static_cast<size_t>(std::numeric_limits<int>::max())) ||
+        (document_freqs.size() != static_cast<size_t>(term_count))) {
+        throw std::invalid_argument("Invalid index in snapshot");
+    }
+    removed_count_ = 0;
+    for (const char is_removed : is_removed_) {
+        if ((is_removed != 0) && (is_removed != 1)) {
+            throw std::invalid_argument("Invalid index in snapshot");
+        }
+        removed_count_ += is_removed;
+    }
+    // idf takes logarithms of them
+    for (const uint64_t document_freq : document_freqs) {
+        if (document_freq > is_removed_.size() - removed_count_) {
+            throw std::invalid_argument("Invalid index in snapshot");
+        }
+    }
+    document_freqs_.assign(document_freqs.begin(), document_freqs.end());
+    GrowLogarithms();
+
+    segments_.clear();
+    segment_removed_counts_.clear();
+    int first_ordinal = 0;
+    const uint64_t segment_count = reader.Read<uint64_t>();
+    for (uint64_t i = 0; i < segment_count; ++i) {
+        auto segment = std::make_shared<Segment>();
+        segment->first_ordinal = first_ordinal;
+        segment->file = file;
+        LoadSegment(reader, *segment, term_count, is_removed_.size());
+        first_ordinal = segment->GetEndOrdinal();
+        const size_t removed_count = std::count(is_removed_.begin() + segment->first_ordinal, is_removed_.begin() + first_ordinal, 1);
+        if (segment->dropped_count > removed_count) {
+            throw std::invalid_argument("Invalid index in snapshot");
+        }
+        segments_.push_back(std::move(segment));
+        segment_removed_counts_.push_back(removed_count);
+    }
+    if (static_cast<size_t>(first_ordinal) != is_removed_.size()) {
+        throw std::invalid_argument("Invalid index in snapshot");
+    }
+    buffer_ = Segment();
+    buffer_.first_ordinal = first_ordinal;
+    buffer_postings_.assign(term_count, PostingList());
+    buffer_removed_count_ = 0;
+}
+
+size_t InvertedIndex::FindSegment(int document_ordinal) const {
+    if (document_ordinal >= buffer_.first_ordinal) {
+        return segments_.size();
+    }
+    const auto it = std::upper_bound(segments_.begin(), segments_.end(), document_ordinal,
+        [](int ordinal, const std::shared_ptr<const Segment>& segment) { return ordinal < segment->first_ordinal; });
+    return it - segments_.begin() - 1;
+}
+
+const InvertedIndex::Segment& InvertedIndex::GetSegment(size_t segment) const {
+    return segment < segments_.size() ? *segments_[segment] : buffer_;
+}
+
+const InvertedIndex::PostingList* InvertedIndex::FindPostings(size_t segment, int term_id) const {
+    if (segment < segments_.size()) {
+        return segments_[segment]->FindPostings(term_id);
+    }
+    const PostingList& postings = buffer_postings_[term_id];
+    return postings.size > 0 ? &postings : nullptr;
+}
+
+void InvertedIndex::SealBuffer() {
+    auto segment = std::make_shared<Segment>();
+    segment->first_ordinal = buffer_.first_ordinal;
+    segment->document_lengths = std::move(buffer_.document_lengths);
+    segment->inverse_document_lengths = std::move(buffer_.inverse_document_lengths);
+    for (size_t term_id = 0; term_id < buffer_postings_.size(); ++term_id) {
+        PostingList& postings = buffer_postings_[term_id];
+        if (postings.size > 0) {
+            SealPostings(postings);
+            segment->term_ids.push_back(static_cast<int>(term_id));
+            segment->postings.push_back(std::move(postings));
+        }
+    }
+    segments_.push_back(std::move(segment));
+    segment_removed_counts_.push_back(buffer_removed_count_);
+
+    buffer_ = Segment();
+    buffer_.first_ordinal = segments_.back()->GetEndOrdinal();
+    buffer_postings_.assign(terms_.GetIdLimit(), PostingList());
+    buffer_removed_count_ = 0;
+}
+
+std::pair<size_t, size_t> InvertedIndex::SelectMerge() const {
+    std::vector<size_t> levels(segments_.size());
+    for (size_t i = 0; i < segments_.size(); ++i) {
+        const Segment& segment = *segments_[i];
+        const size_t live_count = segment.document_lengths.size() - segment_removed_counts_[i];
+        // removed documents which still have postings here
+        const size_t dead_count = segment_removed_counts_[i] - segment.dropped_count;
+        if (dead_count > live_count) {
+            return { i, i + 1 };
+        }
+        for (size_t size = BUFFER_DOCUMENT_COUNT * MERGE_FACTOR; size <= live_count; size *= MERGE_FACTOR) {
+            ++levels[i];
+        }
+    }
+    for (size_t first = 0, last = 0; first < segments_.size(); first = last) {
+        while (last < segments_.size() && levels[last] == levels[first]) {
+            ++last;
+        }
+        if (last - first >= MERGE_FACTOR) {
+            return { first, first + MERGE_FACTOR };
+        }
+    }
+    return { 0, 0 };
+}
+
+void InvertedIndex::GrowLogarithms() {
+    while (logarithms_.size() <= is_removed_.size() + 1) {
+        logarithms_.push_back(std::log(static_cast<double>(logarithms_.size())));
+    }
+    while (half_logarithms_.size() <= is_removed_.size()) {
+        half_logarithms_.push_back(std::log(half_logarithms_.size() + 0.5));
+    }
+}
+
+void InvertedIndex::StartMerge() {
+    const auto [first, last] = SelectMerge();
+    if (first == last) {
+        return;
+    }
+    std::vector<std::shared_ptr<const Segment>> sources(segments_.begin() + first, segments_.begin() + last);
+    // tombstones are copied, later ones stay in is_removed_ until the next merge
+    std::vector<char> is_removed(is_removed_.begin() + sources.front()->first_ordinal, is_removed_.begin() + sources.back()->GetEndOrdinal());
+    merge_ = std::async(std::launch::async,
+        [sources = std::move(sources), is_removed = std::move(is_removed)] {
+            return MergeSegments(sources, is_removed);
+        }).share();
+}
+
+void InvertedIndex::InstallMerge(const MergedSegment& merged) {
+    const auto first = std::find_if(segments_.begin(), segments_.end(),
+        [&merged](const std::shared_ptr<const Segment>& segment) { return segment.get() == merged.sources.front(); });
+    if (static_cast<size_t>(segments_.end() - first) < merged.sources.size() ||
+        !std::equal(merged.sources.begin(), merged.sources.end(), first,
+            [](const Segment* source, const std::shared_ptr<const Segment>& segment) { return source == segment.get(); })) {
+        return;
+    }
+    const size_t index = first - segments_.begin();
+    const size_t last = index + merged.sources.size();
+    size_t removed_count = 0;
+    for (size_t i = index; i < last; ++i) {
+        removed_count += segment_removed_counts_[i];
+    }
+    segments_[index] = merged.segment;
+    segments_.erase(segments_.begin() + index + 1, segments_.begin() + last);
+    segment_removed_counts_[index] = removed_count;
+    segment_removed_counts_.erase(segment_removed_counts_.begin() + index + 1, segment_removed_counts_.begin() + last);
+}
+
+InvertedIndex::MergedSegment InvertedIndex::MergeSegments(const std::vector<std::shared_ptr<const Segment>>& sources, const std::vector<char>& is_removed) {
+    auto segment = std::make_shared<Segment>();
+    segment->first_ordinal = sources.front()->first_ordinal;
+    std::vector<int> term_ids;
+    for (const auto& source : sources) {
+        segment->document_lengths.insert(segment->document_lengths.end(), source->document_lengths.begin(), source->document_lengths.end());
+        segment->inverse_document_lengths.insert(segment->inverse_document_lengths.end(),
+            source->inverse_document_lengths.begin(), source->inverse_document_lengths.end());
+        term_ids.insert(term_ids.end(), source->term_ids.begin(), source->term_ids.end());
+    }
+    std::sort(term_ids.begin(), term_ids.end());
+    term_ids.erase(std::unique(term_ids.begin(), term_ids.end()), term_ids.end());
+
+    int ordinals[BLOCK_SIZE];
+    uint32_t term_counts[BLOCK_SIZE];
+    for (const int term_id : term_ids) {
+        PostingList merged_postings;
+        for (const auto& source : sources) {
+            const PostingList* postings = source->FindPostings(term_id);
+            if (postings == nullptr) {
+                continue;
+            }
+            for (size_t block = 0; block < postings->GetBlockCount(); ++block) {
+                const size_t count = DecodeBlock(*postings, block, ordinals, term_counts);
+                for (size_t i = 0; i < count; ++i) {
+                    if (!is_removed[ordinals[i] - segment->first_ordinal]) {
+                        AppendPosting(*segment, merged_postings, { ordinals[i], term_counts[i] });
+                    }
+                }
+            }
+        }
+        // lists of removed documents only are dropped with them
+        if (merged_postings.size > 0) {
+            SealPostings(merged_postings);
+            segment->term_ids.push_back(term_id);
+            segment->postings.push_back(std::move(merged_postings));
+        }
+    }
+
+    segment->dropped_count = std::count(is_removed.begin(), is_removed.end(), 1);
+
+    MergedSegment merged;
+    merged.segment = std::move(segment);
+    for (const auto& source : sources) {
+        merged.sources.push_back(source.get());
+    }
+    return merged;
+}
+
+std::shared_ptr<const InvertedIndex::Segment> InvertedIndex::CompactSegment(const Segment& source, const std::vector<int>& new_ordinals) {
+    auto segment = std::make_shared<Segment>();
+    for (int ordinal = source.first_ordinal; ordinal < source.GetEndOrdinal(); ++ordinal) {
+        if (new_ordinals[ordinal] < 0) {
+            continue;
+        }
+        if (segment->document_lengths.empty()) {
+            segment->first_ordinal = new_ordinals[ordinal];
+        }
+        segment->document_lengths.push_back(source.document_lengths[ordinal - source.first_ordinal]);
+        segment->inverse_document_lengths.push_back(source.inverse_document_lengths[ordinal - source.first_ordinal]);
+    }
+
+    int ordinals[BLOCK_SIZE];
+    uint32_t term_counts[BLOCK_SIZE];
+    for (size_t i = 0; i < source.term_ids.size(); ++i) {
+        const PostingList& postings = source.postings[i];
+        PostingList compacted_postings;
+        for (size_t block = 0; block < postings.GetBlockCount(); ++block) {
+            const size_t count = DecodeBlock(postings, block, ordinals, term_counts);
+            for (size_t j = 0; j < count; ++j) {
+                if (new_ordinals[ordinals[j]] >= 0) {
+                    AppendPosting(*segment, compacted_postings, { new_ordinals[ordinals[j]], term_counts[j] });
+                }
+            }
+        }
+        if (compacted_postings.size > 0) {
+            SealPostings(compacted_postings);
+            segment->term_ids.push_back(source.term_ids[i]);
+            segment->postings.push_back(std::move(compacted_postings));
+        }
+    }
+    return segment;
+}
+
+void InvertedIndex::SaveSegment(SnapshotWriter& writer, const Segment& segment, const std::vector<int>& term_numbers) {
+    writer.Write<int32_t>(segment.first_ordinal);
+    writer.WriteArray(segment.document_lengths);
+    writer.Write<uint64_t>(segment.dropped_count);
+    // lists go in order of numbers, which are ids of loaded terms
+    std::vector<std::pair<int, const PostingList*>> lists;
+    for (size_t i = 0; i < segment.term_ids.size(); ++i) {
+        if (const int number = term_numbers[segment.term_ids[i]]; number >= 0) {
+            lists.emplace_back(number, &segment.postings[i]);
+        }
+    }
+    std::sort(lists.begin(), lists.end(), [](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+    writer.Write<uint64_t>(lists.size());
+    for (const auto& [number, postings] : lists) {
+        writer.Write<int32_t>(number);
+        writer.Write<uint64_t>(postings->size);
+        writer.Write(postings->bounds);
+        writer.WriteAlignedArray(postings->GetBlocks(), postings->GetBlockCount());
+        writer.WriteAlignedArray(postings->GetBlockBounds(), postings->GetBlockCount());
+        writer.WriteAlignedArray(postings->GetData(), postings->GetDataSize());
+    }
+}
+
+void InvertedIndex::LoadSegment(SnapshotReader& reader, Segment& segment, int term_count, size_t document_count) {
+    if (reader.Read<int32_t>() != segment.first_ordinal) {
+        throw std::invalid_argument("Invalid index in snapshot");
+    }
+    reader.ReadArray(segment.document_lengths);
+    if (segment.document_lengths.size() > document_count - segment.first_ordinal) {
+        throw std::invalid_argument("Invalid index in snapshot");
+    }
+    for (const int word_count : segment.document_lengths) {
+        if (word_count < 0) {
+            throw std::invalid_argument("Invalid index in snapshot");
+        }
+        segment.inverse_document_lengths.push_back(word_count > 0 ? 1.0 / word_count : 0.0);
+    }
+    segment.dropped_count = reader.Read<uint64_t>();
+
+    const uint64_t list_count = reader.Read<uint64_t>();
+    for (uint64_t i = 0; i < list_count; ++i) {
+        const int term_id = reader.Read<int32_t>();
+        if ((term_id < 0) || (term_id >= term_count) || (!segment.term_ids.empty() && segment.term_ids.back() >= term_id)) {
+            throw std::invalid_argument("Invalid posting list in snapshot");
+        }
+        PostingList postings;
+        postings.size = reader.Read<uint64_t>();
+        postings.bounds = reader.Read<ScoreBounds>();
+        postings.base_ordinal = segment.first_ordinal - 1;
+        postings.is_sealed = true;
+        size_t block_count = 0;
+        size_t block_bound_count = 0;
+        postings.mapped_blocks = reader.ReadAlignedArray<Block>(block_count);
+        postings.mapped_block_bounds = reader.ReadAlignedArray<ScoreBounds>(block_bound_count);
+        postings.mapped_data = reader.ReadAlignedArray<uint8_t>(postings.mapped_data_size);
+        if ((postings.size == 0) || (postings.size > segment.document_lengths.size()) ||
+            (block_count != postings.GetBlockCount()) || (block_bound_count != block_count) ||
+            !IsValidPostings(segment, postings)) {
+            throw std::invalid_argument("Invalid posting list in snapshot");
+        }
+        segment.term_ids.push_back(term_id);
+        segment.postings.push_back(postings);
+    }
+}
+
+bool InvertedIndex::IsValidPostings(const Segment& segment, const PostingList& postings) {
+    const uint8_t* data = postings.GetData();
+    const Block* blocks = postings.GetBlocks();
+    const ScoreBounds* block_bounds = postings.GetBlockBounds();
+    const size_t block_count = postings.GetBlockCount();
+    // summed in 64 bits, gaps of invalid list may overflow int
+    int64_t ordinal = postings.base_ordinal;
+    ScoreBounds bounds;
+    uint32_t gaps[BLOCK_SIZE];
+    uint32_t term_counts[BLOCK_SIZE];
+    for (size_t block = 0; block < block_count; ++block) {
+        const size_t first = blocks[block].offset;
+        const size_t last = block + 1 < block_count ? blocks[block + 1].offset : postings.GetDataSize();
+        if ((first > last) || (last > postings.GetDataSize()) || (last - first < 2)) {
+            return false;
+        }
+        const int gap_bits = data[first];
+        const int term_count_bits = data[first + 1];
+        const size_t count = std::min(BLOCK_SIZE, postings.size - block * BLOCK_SIZE);
+        const size_t group_count = GetGroupCount(count);
+        if ((gap_bits > 32) || (term_count_bits > 32) ||
+            (last - first < 2 + group_count * (gap_bits + term_count_bits) + sizeof(uint64_t) - 1)) {
+            return false;
+        }
+        UnpackBits(data + first + 2, gap_bits, group_count, gaps);
+        UnpackBits(data + first + 2 + group_count * gap_bits, term_count_bits, group_count, term_counts);
+        ScoreBounds block_bound;
+        for (size_t i = 0; i < count; ++i) {
+            ordinal += int64_t{ gaps[i] } + 1;
+            if (ordinal >= segment.GetEndOrdinal()) {
+                return false;
+            }
+            const size_t index = static_cast<size_t>(ordinal - segment.first_ordinal);
+            const uint64_t term_count = uint64_t{ term_counts[i] } + 1;
+            if (term_count > static_cast<uint64_t>(segment.document_lengths[index])) {
+                return false;
+            }
+            MergeBounds(block_bound, { static_cast<uint32_t>(term_count) * segment.inverse_document_lengths[index],
+                static_cast<uint32_t>(term_count), segment.document_lengths[index] });
+        }
+        if ((ordinal != blocks[block].last_ordinal) || !IsEqual(block_bound, block_bounds[block])) {
+            return false;
+        }
+        MergeBounds(bounds, block_bound);
+    }
+    return IsEqual(bounds, postings.bounds);
+}
+
+void InvertedIndex::AppendPosting(const Segment& segment, PostingList& postings, Posting posting) {
+    const size_t index = posting.document_ordinal - segment.first_ordinal;
+    const ScoreBounds posting_bounds = { posting.term_count * segment.inverse_document_lengths[index],
+        posting.term_count, segment.document_lengths[index] };
+    if (postings.size == 0) {
+        postings.base_ordinal = segment.first_ordinal - 1;
+    }
+    const int previous_ordinal = postings.blocks.empty() ? postings.base_ordinal : postings.blocks.back().last_ordinal;
+    if (postings.size % BLOCK_SIZE == 0) {
+        postings.blocks.push_back({ posting.document_ordinal, static_cast<uint32_t>(postings.data.size()) });
+        postings.block_bounds.push_back(posting_bounds);
+    }
+    else {
+        postings.blocks.back().last_ordinal = posting.document_ordinal;
+        MergeBounds(postings.block_bounds.back(), posting_bounds);
+    }
+    WriteVarint(postings.data, static_cast<uint32_t>(posting.document_ordinal - previous_ordinal));
+    WriteVarint(postings.data, posting.term_count);
+    ++postings.size;
+    MergeBounds(postings.bounds, posting_bounds);
+    if (postings.size % BLOCK_SIZE == 0) {
+        PackLastBlock(postings);
+    }
+}
+
+void InvertedIndex::SealPostings(PostingList& postings) {
+    if (postings.size % BLOCK_SIZE != 0) {
+        PackLastBlock(postings);
+    }
+    postings.is_sealed = true;
+    // appends left spare capacity
+    postings.data.shrink_to_fit();
+    postings.blocks.shrink_to_fit();
+    postings.block_bounds.shrink_to_fit();
+}
+
+void InvertedIndex::PackLastBlock(PostingList& postings) {
+    const size_t block = postings.blocks.size() - 1;
+    const size_t count = postings.size - block * BLOCK_SIZE;
+    int previous_ordinal = block > 0 ? postings.blocks[block - 1].last_ordinal : postings.base_ordinal;
+    int ordinals[BLOCK_SIZE];
+    uint32_t term_counts[BLOCK_SIZE];
+    DecodeVarints(postings.data.data() + postings.blocks[block].offset, previous_ordinal, count, ordinals, term_counts);
+
+    // gaps and counts are at least 1, so they are stored minus one: all-ones counts take no bits
+    uint32_t gaps[BLOCK_SIZE];
+    for (size_t i = 0; i < count; ++i) {
+        gaps[i] = static_cast<uint32_t>(ordinals[i] - previous_ordinal - 1);
+        previous_ordinal = ordinals[i];
+        --term_counts[i];
+    }
+    const int gap_bits = GetBitWidth(gaps, count);
+    const int term_count_bits = GetBitWidth(term_counts, count);
+
+    postings.data.resize(postings.blocks[block].offset);
+    postings.data.push_back(static_cast<uint8_t>(gap_bits));
+    postings.data.push_back(static_cast<uint8_t>(term_count_bits));
+    PackBits(postings.data, gaps, count, gap_bits);
+    PackBits(postings.data, term_counts, count, term_count_bits);
+    // padding for 8-byte loads of the last values
+    postings.data.resize(postings.data.size() + sizeof(uint64_t) - 1, 0);
+}
+
+size_t InvertedIndex::DecodeBlock(const PostingList& postings, size_t block, int* ordinals, uint32_t* term_counts) {
+    const Block* blocks = postings.GetBlocks();
+    const uint8_t* data = postings.GetData() + blocks[block].offset;
+    int ordinal = block > 0 ? blocks[block - 1].last_ordinal : postings.base_ordinal;
+    const size_t count = std::min(BLOCK_SIZE, postings.size - block * BLOCK_SIZE);
+    if (count < BLOCK_SIZE && !postings.is_sealed) {
+        // last block is not full yet, it is kept in varints to be appended
+        DecodeVarints(data, ordinal, count, ordinals, term_counts);
+        return count;
+    }
+
+    const int gap_bits = data[0];
+    const int term_count_bits = data[1];
+    const size_t group_count = GetGroupCount(count);
+    uint32_t gaps[BLOCK_SIZE];
+    UnpackBits(data + 2, gap_bits, group_count, gaps);
+    UnpackBits(data + 2 + group_count * gap_bits, term_count_bits, group_count, term_counts);
+    for (size_t i = 0; i < count; ++i) {
+        ordinal += static_cast<int>(gaps[i]) + 1;
+        ordinals[i] = ordinal;
+        ++term_counts[i];
+    }
+    return count;
+}
@@ -0,0 +1,303 @@
+#pragma once
+
+#include <cstdint>
+#include <future>
+#include <limits>
+#include <memory>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "snapshot.h"
+#include "term_dictionary.h"
+
+// term dictionary + posting lists sorted by document ordinal.
+// Lists are compressed by blocks of BLOCK_SIZE postings: gaps between ordinals and term counts
+// of full blocks are bit-packed with the width of the largest value of the block, the last block
+// is kept in varints until it is full or the list is sealed. Term frequency is restored as
+// term count / document length.
+//
+// Ordinals are split into segments (log-structured): new documents go to the mutable buffer,
+// which is sealed into a read-only segment of BUFFER_DOCUMENT_COUNT documents. Sealed segments are
+// never changed, so copies of the index share them. Removed documents are tombstones skipped by
+// iterators, their postings are dropped when the segment is merged. Merges run on their own thread,
+// a finished one is installed by the next Flush. Merges keep ordinals of removed documents, they are
+// dropped by compaction of ordinals when removed documents are the most.
+class InvertedIndex {
+public:
+    static constexpr int NO_TERM = TermDictionary::NO_TERM;
+    static constexpr size_t BLOCK_SIZE = 128;
+    // documents of the buffer which is sealed into segment
+    static constexpr size_t BUFFER_DOCUMENT_COUNT = 4096;
+    // so many neighbouring segments of one size level are merged, the level is MERGE_FACTOR times larger
+    static constexpr size_t MERGE_FACTOR = 4;
+    // ordinals are compacted when removed documents are more than present ones and at least so many
+    static constexpr size_t MIN_COMPACTED_COUNT = BUFFER_DOCUMENT_COUNT;
+
+    struct Posting {
+        int document_ordinal;
+        uint32_t term_count;
+    };
+
+    // statistics of postings from which rankings compute upper bound of their score
+    struct ScoreBounds {
+        double max_term_freq = 0.0;
+        uint32_t max_term_count = 0;
+        int min_document_length = std::numeric_limits<int>::max();
+    };
+
+    // BLOCK_SIZE consecutive postings, blocks are searched by last ordinals on every seek,
+    // so their bounds are kept apart
+    struct Block {
+        int last_ordinal;
+        uint32_t offset;
+    };
+
+    // arrays are read through getters: lists of loaded snapshot point into the mapped file
+    // and leave the vectors empty
+    struct PostingList {
+        std::vector<uint8_t> data;
+        std::vector<Block> blocks;
+        // bounds of blocks for skipping in top-k search, the block is decoded only if it can't be skipped
+        std::vector<ScoreBounds> block_bounds;
+        // arrays in the mapped file, nullptr if the list owns its arrays
+        const uint8_t* mapped_data = nullptr;
+        size_t mapped_data_size = 0;
+        const Block* mapped_blocks = nullptr;
+        const ScoreBounds* mapped_block_bounds = nullptr;
+        size_t size = 0;
+        ScoreBounds bounds;
+        // first gap is counted from the ordinal before the segment
+        int base_ordinal = -1;
+        // list of read-only segment, its last block is bit-packed too
+        bool is_sealed = false;
+
+        const uint8_t* GetData() const;
+        size_t GetDataSize() const;
+        const Block* GetBlocks() const;
+        const ScoreBounds* GetBlockBounds() const;
+        size_t GetBlockCount() const;
+    };
+
+    // decodes posting lists of one term block by block, segment by segment
+    class PostingIterator {
+    public:
+        // starts from first posting not less than first_ordinal
+        PostingIterator(const InvertedIndex& index, int term_id, int first_ordinal);
+
+        bool IsEnd() const;
+        // ordinal and term frequency are valid after construction, Next and Seek, not after SeekBlock
+        int GetOrdinal() const;
+        uint32_t GetTermCount() const;
+        double GetTermFreq() const;
+        int GetDocumentLength() const;
+        void Next();
+        const ScoreBounds& GetBlockBounds() const;
+        // moves to block which may contain ordinal without decoding it, false if there is no such block
+        bool SeekBlock(int ordinal);
+        // moves to first posting not less than ordinal, true if it is equal
+        bool Seek(int ordinal);
+
+    private:
+        const InvertedIndex* index_;
+        int term_id_;
+        // segment of postings_, segments_.size() for the buffer
+        size_t segment_ = 0;
+        // nullptr at the end
+        const PostingList* postings_ = nullptr;
+        int first_ordinal_ = 0;
+        const double* inverse_document_lengths_ = nullptr;
+        const int* document_lengths_ = nullptr;
+        // tombstones by ordinal, nullptr if no document is removed
+        const char* is_removed_;
+        size_t block_ = 0;
+        size_t position_ = 0;
+        // block_ which is in buffers, block count if none
+        size_t decoded_block_ = 0;
+        // zero at the end of the list
+        size_t decoded_size_ = 0;
+        int ordinals_[BLOCK_SIZE];
+        uint32_t term_counts_[BLOCK_SIZE];
+        double term_freqs_[BLOCK_SIZE];
+
+        // opens list of the term in the first segment starting from segment which has it
+        // and ordinals not less than min_ordinal, false at the end
+        bool OpenSegment(size_t segment, int min_ordinal);
+        void NextBlock();
+        // postings of removed documents are not put into buffers, so it may decode none
+        void DecodeBlock();
+    };
+
+    // returns NO_TERM if word is not in dictionary
+    int FindTerm(const std::string_view word) const;
+    // the word is copied into dictionary
+    int AddTerm(const std::string_view word);
+    // term id may be given to another word later: postings left in segments under this id
+    // belong to removed documents, so iterators never return them
+    void RemoveTerm(int term_id);
+    // bytes of removed words are released, views given by GetTerm before are not valid any more
+    void CompactTerms();
+
+    // number of words of document without stop words, it is set before postings of the document.
+    // Documents are added in order of ordinals, every one goes to the buffer
+    void SetDocumentLength(int document_ordinal, int word_count);
+    int GetDocumentLength(int document_ordinal) const;
+    // postings of the buffer documents, postings of different terms may be added from different threads
+    void AddPosting(int term_id, int document_ordinal, uint32_t term_count);
+    // tombstones for sorted ordinals, they are not returned by iterators from now on
+    void RemoveDocuments(const std::vector<int>& document_ordinals);
+    // count documents with the term were just removed: their postings stay in lists as tombstones,
+    // only the document freq drops, so caller counts every removed document once
+    void DecrementDocumentFreq(int term_id, size_t count);
+
+    // seals the buffer if it is full or force is set, installs finished merge and starts the next one
+    void Flush(bool force = false);
+    // waits for background merges until merge policy has nothing to merge
+    void WaitMerges();
+    // read-only segments, the buffer is not counted
+    size_t GetSegmentCount() const;
+    bool NeedsCompaction() const;
+    // present documents get dense ordinals in the same order, removed ones are dropped from all segments,
+    // so arrays by ordinal don't grow with removed documents. Returns new ordinal for every old one,
+    // -1 for removed. The buffer is sealed, merge in progress is dropped
+    std::vector<int> CompactOrdinals();
+
+    PostingIterator GetPostings(int term_id, int first_ordinal = 0) const;
+    // number of documents with term which are not removed
+    size_t GetDocumentFreq(int term_id) const;
+    // log(document_count / document freq) without calling log, document_count can't exceed number of set documents
+    double GetInverseDocumentFreq(int term_id, size_t document_count) const;
+    // log((document_count + 1) / (document freq + 0.5)) without calling log, idf of BM25
+    double GetSmoothedInverseDocumentFreq(int term_id, size_t document_count) const;
+    // bounds of lists of all segments
+    ScoreBounds GetScoreBounds(int term_id) const;
+    // view into dictionary, it is valid until the term is removed
+    std::string_view GetTerm(int term_id) const;
+    // number of words in dictionary
+    int GetTermCount() const;
+    const TermDictionary& GetTerms() const;
+    bool IsRemoved(int document_ordinal) const;
+
+    // writes tombstones, document freqs and segments, the buffer is written as one more sealed segment.
+    // Terms are written by numbers: term_numbers[term_id] for live terms, -1 for the rest
+    void Save(SnapshotWriter& writer, const std::vector<int>& term_numbers) const;
+    // the dictionary has only terms of snapshot with their numbers as ids, snapshot must have document_count
+    // documents. Posting lists are not copied, they point into file, which is kept alive by segments.
+    // Lists are checked before they are used, throws std::invalid_argument on invalid ones
+    void Load(SnapshotReader& reader, std::shared_ptr<const MappedFile> file, size_t document_count);
+
+private:
+    // documents [first_ordinal, GetEndOrdinal()) and their postings, lengths are kept here
+    // for term frequencies, so merge reads nothing but its segments
+    struct Segment {
+        int first_ordinal = 0;
+        std::vector<int> document_lengths;
+        // term frequency is computed with multiplication
+        std::vector<double> inverse_document_lengths;
+        // sorted ids of terms having postings in segment and their lists, empty in the buffer
+        std::vector<int> term_ids;
+        std::vector<PostingList> postings;
+        // removed documents whose postings were dropped by merge
+        size_t dropped_count = 0;
+        // snapshot the lists point into, nullptr if they own their arrays
+        std::shared_ptr<const MappedFile> file;
+
+        int GetEndOrdinal() const;
+        // nullptr if term has no postings here
+        const PostingList* FindPostings(int term_id) const;
+    };
+
+    // result of background merge
+    struct MergedSegment {
+        std::shared_ptr<const Segment> segment;
+        // merged segments in order, they are replaced if the index still has them
+        std::vector<const Segment*> sources;
+    };
+
+    TermDictionary terms_;
+    std::vector<size_t> document_freqs_;
+
+    std::vector<std::shared_ptr<const Segment>> segments_;
+    // tombstones among documents of every one of segments_, for merge policy
+    std::vector<size_t> segment_removed_counts_;
+    Segment buffer_;
+    // lists of the buffer by term id, so postings are appended without lookup
+    std::vector<PostingList> buffer_postings_;
+    size_t buffer_removed_count_ = 0;
+
+    // tombstones by ordinal, ordinals are not reused
+    std::vector<char> is_removed_;
+    size_t removed_count_ = 0;
+    // log(n) for n up to number of documents + 1, both document count and document freq are in this range,
+    // so idf is difference of two of them. Grows with documents, one log per document
+    std::vector<double> logarithms_;
+    // log(n + 0.5) for n up to number of documents, for smoothed document freq
+    std::vector<double> half_logarithms_;
+    // shared, so copies of index may install it too
+    std::shared_future<MergedSegment> merge_;
+
+    // segments_.size() for the buffer
+    size_t FindSegment(int document_ordinal) const;
+    const Segment& GetSegment(size_t segment) const;
+    const PostingList* FindPostings(size_t segment, int term_id) const;
+
+    // logarithm tables cover every document count up to is_removed_.size()
+    void GrowLogarithms();
+    void SealBuffer();
+    // [first, last) of segments_ to merge: a segment whose postings are mostly of removed documents alone,
+    // else the first MERGE_FACTOR neighbours of one level. first == last if there is nothing to merge
+    std::pair<size_t, size_t> SelectMerge() const;
+    void StartMerge();
+    void InstallMerge(const MergedSegment& merged);
+    // is_removed are tombstones of ordinals of sources
+    static MergedSegment MergeSegments(const std::vector<std::shared_ptr<const Segment>>& sources, const std::vector<char>& is_removed);
+    // present documents of source with their new ordinals, which are consecutive. Empty if there are none
+    static std::shared_ptr<const Segment> CompactSegment(const Segment& source, const std::vector<int>& new_ordinals);
+
+    // posting must go after all postings of the list, its document is in segment
+    static void AppendPosting(const Segment& segment, PostingList& postings, Posting posting);
+    // packs the last block, so list can't be appended any more
+    static void SealPostings(PostingList& postings);
+    // last block is encoded again with bit-packing
+    static void PackLastBlock(PostingList& postings);
+    static void SaveSegment(SnapshotWriter& writer, const Segment& segment, const std::vector<int>& term_numbers);
+    // lists of segment point into the data of reader
+    // segment has first_ordinal and file set, it must end not later than document_count
+    static void LoadSegment(SnapshotReader& reader, Segment& segment, int term_count, size_t document_count);
+    // checks structure of every block and that bounds match postings, so loaded list is safe to decode
+    static bool IsValidPostings(const Segment& segment, const PostingList& postings);
+    // returns number of postings in block
+    static size_t DecodeBlock(const PostingList& postings, size_t block, int* ordinals, uint32_t* term_counts);
+};
+
+// called for every posting, so they are inline
+
+inline bool InvertedIndex::PostingIterator::IsEnd() const {
+    return position_ >= decoded_size_;
+}
+
+inline int InvertedIndex::PostingIterator::GetOrdinal() const {
+    return ordinals_[position_];
+}
+
+inline uint32_t InvertedIndex::PostingIterator::GetTermCount() const {
+    return term_counts_[position_];
+}
+
+inline double InvertedIndex::PostingIterator::GetTermFreq() const {
+    return term_freqs_[position_];
+}
+
+inline int InvertedIndex::PostingIterator::GetDocumentLength() const {
+    return document_lengths_[ordinals_[position_] - first_ordinal_];
+}
+
+inline void InvertedIndex::PostingIterator::Next() {
+    if (++position_ == decoded_size_) {
+        NextBlock();
+    }
+}
+
+inline const InvertedIndex::ScoreBounds& InvertedIndex::PostingIterator::GetBlockBounds() const {
+    return postings_->GetBlockBounds()[block_];
+}
@@ -22,6 +22,26 @@ int main() {
     //Test09();
     Test10();
     Test11();
+    Test12();
+    Test13();
+    Test14();
+    Test15();
+    Test16();
+    Test17();
+    Test18();
+    Test19();
+    Test20();
+    Test21();
+    Test22();
+    Test23();
+    Test24();
+    Test25();
+    Test26();
+    Test27();
+    Test28();
+    Test29();
+    Test30();
+    Test31();
     
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,24 @@
+#include "ordinal_set.h"
+
+void OrdinalSet::Insert(int ordinal) {
+    const size_t word = static_cast<size_t>(ordinal) >> 6;
+    if (word >= words_.size()) {
+        words_.resize(word + 1, 0);
+    }
+    words_[word] |= uint64_t{ 1 } << (ordinal & 63);
+}
+
+void OrdinalSet::Erase(int ordinal) {
+    const size_t word = static_cast<size_t>(ordinal) >> 6;
+    if (word < words_.size()) {
+        words_[word] &= ~(uint64_t{ 1 } << (ordinal & 63));
+    }
+}
+
+void OrdinalSet::Clear() {
+    words_.clear();
+}
+
+void OrdinalSet::Reset(size_t ordinal_count) {
+    words_.assign((ordinal_count + 63) / 64, 0);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Dense bitset of document ordinals, one bit per ordinal. It filters documents during scoring:
+// a lookup is one shift of a word, and the set of 1M documents takes 128 KiB.
+class OrdinalSet {
+public:
+    // set grows to the ordinal
+    void Insert(int ordinal);
+    void Erase(int ordinal);
+    bool Contains(int ordinal) const;
+    // empty set keeps its memory for the next use
+    void Clear();
+    // empty set with room for ordinals of [0, ordinal_count), they are inserted without growth
+    void Reset(size_t ordinal_count);
+
+private:
+    std::vector<uint64_t> words_;
+};
+
+inline bool OrdinalSet::Contains(int ordinal) const {
+    const size_t word = static_cast<size_t>(ordinal) >> 6;
+    return word < words_.size() && (words_[word] >> (ordinal & 63) & 1);
+}
@@ -0,0 +1,72 @@
+#include "position_index.h"
+#include "varint.h"
+
+#include <algorithm>
+
+void PositionIndex::Resize(size_t document_count) {
+    documents_.resize(document_count);
+}
+
+size_t PositionIndex::GetDocumentCount() const {
+    return documents_.size();
+}
+
+void PositionIndex::AddPositions(int document_ordinal, int term_id, const uint32_t* positions, size_t count) {
+    auto& document = documents_[document_ordinal];
+    if (!document) {
+        document = std::make_shared<DocumentPositions>();
+    }
+    std::vector<uint8_t>& data = document->data;
+    const uint32_t offset = static_cast<uint32_t>(data.size());
+    uint32_t previous_position = 0;
+    for (size_t i = 0; i < count; ++i) {
+        WriteVarint(data, positions[i] - previous_position);
+        previous_position = positions[i];
+    }
+
+    // terms of loaded documents come in order of ids, so they are appended
+    std::vector<TermPositions>& terms = document->terms;
+    const TermPositions term{ term_id, offset, static_cast<uint32_t>(data.size()) - offset };
+    if (terms.empty() || terms.back().term_id < term_id) {
+        terms.push_back(term);
+    }
+    else {
+        terms.insert(std::lower_bound(terms.begin(), terms.end(), term_id,
+            [](const TermPositions& lhs, int rhs) { return lhs.term_id < rhs; }), term);
+    }
+}
+
+bool PositionIndex::GetPositions(int document_ordinal, int term_id, std::vector<uint32_t>& positions) const {
+    positions.clear();
+    if (!documents_[document_ordinal]) {
+        return false;
+    }
+    const DocumentPositions& document = *documents_[document_ordinal];
+    const auto term = std::lower_bound(document.terms.begin(), document.terms.end(), term_id,
+        [](const TermPositions& lhs, int rhs) { return lhs.term_id < rhs; });
+    if ((term == document.terms.end()) || (term->term_id != term_id)) {
+        return false;
+    }
+    const uint8_t* position = document.data.data() + term->offset;
+    const uint8_t* const last = position + term->size;
+    uint32_t value = 0;
+    while (position < last) {
+        value += ReadVarint(position);
+        positions.push_back(value);
+    }
+    return true;
+}
+
+void PositionIndex::RemoveDocument(int document_ordinal) {
+    documents_[document_ordinal].reset();
+}
+
+void PositionIndex::RenumberDocuments(const std::vector<int>& new_ordinals, size_t document_count) {
+    std::vector<std::shared_ptr<DocumentPositions>> documents(document_count);
+    for (size_t ordinal = 0; ordinal < documents_.size(); ++ordinal) {
+        if (new_ordinals[ordinal] >= 0) {
+            documents[new_ordinals[ordinal]] = std::move(documents_[ordinal]);
+        }
+    }
+    documents_ = std::move(documents);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Positions of words in documents for phrase and NEAR queries. They are kept apart from posting lists
+// by document ordinal, so search without phrases never reads them. Gaps between positions of a term
+// are varints in one byte string of document, terms are sorted by id with offsets into it, so
+// a term is found by binary search. Position is the number of the word in document text, stop words
+// are counted. Documents are shared by copies of index, only the one being added is written.
+class PositionIndex {
+public:
+    // ordinals are less than document_count, documents have no positions until they are added
+    void Resize(size_t document_count);
+    size_t GetDocumentCount() const;
+
+    // terms of document go one by one, positions of term are sorted. Documents may be filled
+    // from different threads
+    void AddPositions(int document_ordinal, int term_id, const uint32_t* positions, size_t count);
+    // sorted positions of term, false if document has none of them
+    bool GetPositions(int document_ordinal, int term_id, std::vector<uint32_t>& positions) const;
+    void RemoveDocument(int document_ordinal);
+    // documents get ordinals of new_ordinals, ones with -1 are dropped
+    void RenumberDocuments(const std::vector<int>& new_ordinals, size_t document_count);
+
+private:
+    struct TermPositions {
+        int term_id;
+        // bytes of gaps in data of document
+        uint32_t offset;
+        uint32_t size;
+    };
+
+    struct DocumentPositions {
+        // sorted by term_id
+        std::vector<TermPositions> terms;
+        std::vector<uint8_t> data;
+    };
+
+    // nullptr for documents without positions
+    std::vector<std::shared_ptr<DocumentPositions>> documents_;
+};
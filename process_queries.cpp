@@ -3,26 +3,46 @@
 std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
     const std::vector<std::string>& queries)
+{
+    return ProcessQueries(ThreadPool::GetDefault(), search_server, queries);
+}
+
+std::vector<Document> ProcessQueriesJoined(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries)
+{
+    return ProcessQueriesJoined(ThreadPool::GetDefault(), search_server, queries);
+}
+
+std::vector<std::vector<Document>> ProcessQueries(
+    ThreadPool& thread_pool,
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries)
 {
     //LOG_DURATION("ProcessQueries");
     std::vector<std::vector<Document>> result(queries.size());
-    // transform version
-    std::transform(std::execution::par,
-              queries.begin(), queries.end(),
-              result.begin(),
-              [&search_server](const std::string& query) {
-                  return search_server.FindTopDocuments(query);
-              });//*/
+    // queries are taken by workers one by one, so long ones don't hold the short ones
+    thread_pool.ParallelFor(0, queries.size(),
+        [&search_server, &queries, &result](size_t i) {
+            result[i] = search_server.FindTopDocuments(queries[i]);
+        });
     return result;
 }
 
 std::vector<Document> ProcessQueriesJoined(
+    ThreadPool& thread_pool,
     const SearchServer& search_server,
     const std::vector<std::string>& queries)
 {
+    // results of queries stay in their tasks' vectors until the exact size of output is known,
+    // so it is allocated once
+    const std::vector<std::vector<Document>> documents = ProcessQueries(thread_pool, search_server, queries);
+    const size_t document_count = std::accumulate(documents.begin(), documents.end(), size_t{ 0 },
+        [](size_t count, const std::vector<Document>& query_documents) { return count + query_documents.size(); });
     std::vector<Document> result;
-    auto process_queries = ProcessQueries(search_server, queries);
-    for (const auto& i : process_queries) { for (const auto& j : i) { result.push_back(j); } } // trivial way
+    result.reserve(document_count);
+    for (const auto& query_documents : documents) {
+        result.insert(result.end(), query_documents.begin(), query_documents.end());
+    }
     return result;
 }
-
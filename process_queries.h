@@ -10,6 +10,7 @@
 
 #include "log_duration.h"
 #include "search_server.h"
+#include "thread_pool.h"
 
 std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
@@ -18,3 +19,89 @@ std::vector<std::vector<Document>> ProcessQueries(
 std::vector<Document> ProcessQueriesJoined(
     const SearchServer& search_server,
     const std::vector<std::string>& queries); //*/
+
+// the same on the given thread pool instead of the default one
+std::vector<std::vector<Document>> ProcessQueries(
+    ThreadPool& thread_pool,
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries);
+
+std::vector<Document> ProcessQueriesJoined(
+    ThreadPool& thread_pool,
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries);
+
+// number of queries in a batch of streaming ProcessQueriesJoined for every thread of the pool
+constexpr size_t QUERIES_PER_THREAD_IN_BATCH = 64;
+
+// calls sink(document) for every found document in order of queries,
+// the next batch of queries is searched while the current one goes to the sink
+template <typename DocumentSink>
+void ProcessQueriesJoined(
+    ThreadPool& thread_pool,
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries,
+    DocumentSink sink);
+
+template <typename DocumentSink>
+void ProcessQueriesJoined(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries,
+    DocumentSink sink)
+{
+    ProcessQueriesJoined(ThreadPool::GetDefault(), search_server, queries, sink);
+}
+
+template <typename DocumentSink>
+void ProcessQueriesJoined(
+    ThreadPool& thread_pool,
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries,
+    DocumentSink sink)
+{
+    const size_t batch_size = thread_pool.GetThreadCount() * QUERIES_PER_THREAD_IN_BATCH;
+    std::vector<std::vector<Document>> ready_batch;
+    std::vector<std::vector<Document>> next_batch;
+    auto process_batch = [&](size_t first, std::vector<std::vector<Document>>& batch) {
+        const size_t last = std::min(first + batch_size, queries.size());
+        batch.resize(last - first);
+        thread_pool.ParallelFor(first, last,
+            [&](size_t i) { batch[i - first] = search_server.FindTopDocuments(queries[i]); });
+    };
+
+    if (queries.empty()) {
+        return;
+    }
+    process_batch(0, ready_batch);
+    for (size_t first = 0; first < queries.size(); first += batch_size) {
+        std::future<void> next;
+        const size_t next_first = first + batch_size;
+        if (next_first < queries.size()) {
+            next = thread_pool.Submit([&process_batch, &next_batch, next_first] { process_batch(next_first, next_batch); });
+        }
+        try {
+            for (const auto& documents : ready_batch) {
+                for (const Document& document : documents) {
+                    sink(document);
+                }
+            }
+        }
+        catch (...) {
+            // the next batch refers to locals, it has to finish before unwinding. Queued tasks are run
+            // while waiting, so a caller from a worker of saturated pool doesn't deadlock, and an error
+            // of the batch itself gives way to the one being thrown
+            if (next.valid()) {
+                try {
+                    thread_pool.Wait(next);
+                }
+                catch (...) {
+                }
+            }
+            throw;
+        }
+        if (next.valid()) {
+            thread_pool.Wait(next);
+            std::swap(ready_batch, next_batch);
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#include "query_cache.h"
+
+#include <algorithm>
+#include <functional>
+
+QueryCache::QueryCache(const SearchServer& search_server, size_t capacity)
+    : search_server_(search_server)
+    , shard_capacity_(std::max<size_t>(1, capacity / SHARD_COUNT))
+    , shards_(SHARD_COUNT)
+{
+}
+
+std::vector<Document> QueryCache::FindTopDocuments(const std::string_view raw_query, DocumentStatus status) {
+    std::string key = search_server_.NormalizeQuery(raw_query);
+    key.push_back(static_cast<char>('0' + static_cast<int>(status)));
+
+    Shard& shard = GetShard(key);
+    const uint64_t generation = search_server_.GetGeneration();
+    {
+        std::lock_guard guard(shard.mutex);
+        Validate(shard, generation);
+        auto it = shard.positions.find(key);
+        if (it != shard.positions.end()) {
+            shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+            ++hits_;
+            return it->second->second;
+        }
+    }
+
+    // searching without lock, equal queries from other threads may be searched at the same time
+    ++misses_;
+    auto documents = search_server_.FindTopDocuments(raw_query, status);
+
+    std::lock_guard guard(shard.mutex);
+    if (shard.generation == generation && shard.positions.count(key) == 0) {
+        shard.entries.emplace_front(std::move(key), documents);
+        shard.positions.emplace(shard.entries.front().first, shard.entries.begin());
+        if (shard.entries.size() > shard_capacity_) {
+            shard.positions.erase(shard.entries.back().first);
+            shard.entries.pop_back();
+        }
+    }
+    return documents;
+}
+
+std::vector<Document> QueryCache::FindTopDocuments(const std::string_view raw_query) {
+    return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
+}
+
+QueryCache::Statistics QueryCache::GetStatistics() const {
+    return { hits_.load(), misses_.load() };
+}
+
+void QueryCache::Clear() {
+    for (Shard& shard : shards_) {
+        std::lock_guard guard(shard.mutex);
+        shard.positions.clear();
+        shard.entries.clear();
+    }
+    hits_ = 0;
+    misses_ = 0;
+}
+
+QueryCache::Shard& QueryCache::GetShard(const std::string& key) {
+    return shards_[std::hash<std::string>{}(key) % SHARD_COUNT];
+}
+
+void QueryCache::Validate(Shard& shard, uint64_t generation) {
+    if (shard.generation != generation) {
+        shard.positions.clear();
+        shard.entries.clear();
+        shard.generation = generation;
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "document.h"
+#include "search_server.h"
+
+constexpr size_t DEFAULT_QUERY_CACHE_CAPACITY = 4096;
+
+// LRU cache of FindTopDocuments results in front of SearchServer.
+// Queries are keyed by their normalized form and status, so "cat dog" and "dog  cat cat" share an entry.
+// Entries are dropped when generation of the server changes (after AddDocument/RemoveDocument).
+// The cache is split into shards with own locks, so it can be used from ProcessQueries workers.
+class QueryCache {
+public:
+    struct Statistics {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+    };
+
+    explicit QueryCache(const SearchServer& search_server, size_t capacity = DEFAULT_QUERY_CACHE_CAPACITY);
+
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status);
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query);
+
+    Statistics GetStatistics() const;
+    void Clear();
+
+private:
+    static constexpr size_t SHARD_COUNT = 16;
+
+    struct Shard {
+        std::mutex mutex;
+        uint64_t generation = 0;
+        // most recently used entries are at the front
+        std::list<std::pair<std::string, std::vector<Document>>> entries;
+        std::unordered_map<std::string_view, decltype(entries)::iterator> positions;
+    };
+
+    const SearchServer& search_server_;
+    const size_t shard_capacity_;
+    std::vector<Shard> shards_;
+    std::atomic<uint64_t> hits_ = 0;
+    std::atomic<uint64_t> misses_ = 0;
+
+    Shard& GetShard(const std::string& key);
+    // drops all entries if server has changed since they were cached, shard must be locked
+    void Validate(Shard& shard, uint64_t generation);
+};
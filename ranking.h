@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+
+#include "inverted_index.h"
+
+// Rankings are template parameters of SearchServer::FindTopDocuments, so the score of posting is
+// computed inline without virtual calls. A ranking is default constructible and has:
+//   TermWeight GetTermWeight(const TermStatistics& statistics) const - once per query word
+//   double GetScore(const TermWeight& weight, const InvertedIndex::PostingIterator& posting) const
+//   double GetMaxScore(const TermWeight& weight, const InvertedIndex::ScoreBounds& bounds) const -
+//       not less than score of any posting within bounds, it is used for skipping by MaxScore
+// Relevance of document is the sum of scores of its postings of plus words.
+
+// statistics of query word among documents which are present in server
+struct TermStatistics {
+    size_t document_count;
+    size_t document_freq;
+    double average_document_length;
+    // log(document_count / document_freq) computed without log
+    double inverse_document_freq;
+    // log((document_count + 1) / (document_freq + 0.5)) computed without log
+    double smoothed_inverse_document_freq;
+};
+
+// constants of query word, meaning of fields is up to the ranking
+struct TermWeight {
+    double weight = 0.0;
+    double saturation = 0.0;
+    double length_scale = 0.0;
+};
+
+// term count / document length * log(document_count / document_freq)
+struct TfIdf {
+    TermWeight GetTermWeight(const TermStatistics& statistics) const {
+        return { statistics.inverse_document_freq };
+    }
+
+    double GetScore(const TermWeight& weight, const InvertedIndex::PostingIterator& posting) const {
+        return posting.GetTermFreq() * weight.weight;
+    }
+
+    double GetMaxScore(const TermWeight& weight, const InvertedIndex::ScoreBounds& bounds) const {
+        return bounds.max_term_freq * weight.weight;
+    }
+};
+
+// Okapi BM25: idf * count * (k1 + 1) / (count + k1 * (1 - b + b * document length / average length)),
+// idf = log(1 + (document_count - document_freq + 0.5) / (document_freq + 0.5)) is never negative,
+// it is the smoothed idf of statistics
+struct Bm25 {
+    double k1 = 1.2;
+    double b = 0.75;
+
+    TermWeight GetTermWeight(const TermStatistics& statistics) const {
+        return { statistics.smoothed_inverse_document_freq * (k1 + 1.0), k1 * (1.0 - b),
+            statistics.average_document_length > 0.0 ? k1 * b / statistics.average_document_length : 0.0 };
+    }
+
+    double GetScore(const TermWeight& weight, const InvertedIndex::PostingIterator& posting) const {
+        const double term_count = posting.GetTermCount();
+        return weight.weight * term_count / (term_count + weight.saturation + weight.length_scale * posting.GetDocumentLength());
+    }
+
+    // score grows with term count and falls with document length
+    double GetMaxScore(const TermWeight& weight, const InvertedIndex::ScoreBounds& bounds) const {
+        const double term_count = bounds.max_term_count;
+        return weight.weight * term_count / (term_count + weight.saturation + weight.length_scale * bounds.min_document_length);
+    }
+};
@@ -1,28 +1,239 @@
 #include "remove_duplicates.h"
 
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <limits>
 #include <map>
-#include <string>
+#include <stdexcept>
 #include <string_view>
-#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include "thread_pool.h"
+
+namespace {
+
+using WordFrequencies = std::map<std::string_view, double>;
+
+// MinHash values per document, LSH splits them into bands of rows
+constexpr int SIGNATURE_SIZE = 128;
+// the most likely miss of a pair of documents with similarity min_similarity
+constexpr double MISS_PROBABILITY = 0.05;
+
+// splitmix64 finalizer, a bijection which spreads every bit of value
+uint64_t Mix(uint64_t value) {
+    value += 0x9e3779b97f4a7c15ULL;
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+// FNV-1a, independent of std::hash, so that halves of fingerprint don't collide together
+uint64_t HashBytes(std::string_view word) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const char c : word) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ULL;
+    }
+    return Mix(hash);
+}
+
+uint64_t HashWord(std::string_view word) {
+    return Mix(std::hash<std::string_view>{}(word));
+}
+
+struct Fingerprint {
+    uint64_t low = 0;
+    uint64_t high = 0;
+
+    bool operator==(const Fingerprint& other) const {
+        return low == other.low && high == other.high;
+    }
+};
+
+struct FingerprintHasher {
+    size_t operator()(const Fingerprint& fingerprint) const {
+        return static_cast<size_t>(fingerprint.low);
+    }
+};
+
+// sums of word hashes, words of document are unique
+Fingerprint GetFingerprint(const WordFrequencies& word_freqs) {
+    Fingerprint fingerprint;
+    for (const auto& [word, freq] : word_freqs) {
+        fingerprint.low += HashWord(word);
+        fingerprint.high += HashBytes(word);
+    }
+    return fingerprint;
+}
+
+bool HaveSameWords(const WordFrequencies& lhs, const WordFrequencies& rhs) {
+    return lhs.size() == rhs.size() && std::equal(lhs.begin(), lhs.end(), rhs.begin(),
+        [](const auto& lhs_word, const auto& rhs_word) { return lhs_word.first == rhs_word.first; });
+}
+
+// Jaccard similarity: common words / all words, words are sorted in both maps
+double GetSimilarity(const WordFrequencies& lhs, const WordFrequencies& rhs) {
+    size_t common_count = 0;
+    auto lhs_it = lhs.begin();
+    auto rhs_it = rhs.begin();
+    while (lhs_it != lhs.end() && rhs_it != rhs.end()) {
+        if (lhs_it->first < rhs_it->first) {
+            ++lhs_it;
+        }
+        else if (rhs_it->first < lhs_it->first) {
+            ++rhs_it;
+        }
+        else {
+            ++common_count;
+            ++lhs_it;
+            ++rhs_it;
+        }
+    }
+    const size_t word_count = lhs.size() + rhs.size() - common_count;
+    return word_count == 0 ? 1.0 : static_cast<double>(common_count) / word_count;
+}
+
+// Documents match in a band if all its rows are equal, that happens with probability similarity^rows.
+// More rows give fewer false candidates, so the most ones which keep the miss probability are taken.
+int GetRowCount(double min_similarity) {
+    int row_count = 1;
+    for (int rows = 1; rows <= SIGNATURE_SIZE; ++rows) {
+        const int band_count = SIGNATURE_SIZE / rows;
+        if (std::pow(1.0 - std::pow(min_similarity, rows), band_count) <= MISS_PROBABILITY) {
+            row_count = rows;
+        }
+    }
+    return row_count;
+}
+
+// MinHash signature: minimum of every of SIGNATURE_SIZE word hash functions over the words,
+// and hash of rows of each band. Hash functions are products of mixed hash by odd numbers,
+// a multiplication is much cheaper than Mix for each of them.
+void GetBandKeys(const WordFrequencies& word_freqs, int row_count, uint64_t* band_keys) {
+    static const auto seeds = [] {
+        std::array<uint64_t, SIGNATURE_SIZE> seeds;
+        for (int i = 0; i < SIGNATURE_SIZE; ++i) {
+            seeds[i] = Mix(i) | 1;
+        }
+        return seeds;
+    }();
+
+    std::array<uint64_t, SIGNATURE_SIZE> signature;
+    signature.fill(std::numeric_limits<uint64_t>::max());
+    for (const auto& [word, freq] : word_freqs) {
+        const uint64_t hash = HashWord(word);
+        for (int i = 0; i < SIGNATURE_SIZE; ++i) {
+            signature[i] = std::min(signature[i], hash * seeds[i]);
+        }
+    }
+
+    const int band_count = SIGNATURE_SIZE / row_count;
+    for (int band = 0; band < band_count; ++band) {
+        // equal rows of different bands give different keys
+        uint64_t key = Mix(band);
+        for (int row = 0; row < row_count; ++row) {
+            key = Mix(key ^ signature[band * row_count + row]);
+        }
+        band_keys[band] = key;
+    }
+}
+
+void RemoveFoundDuplicates(SearchServer& search_server, const std::vector<int>& duplicate_ids) {
+    for (const int document_id : duplicate_ids) {
+        std::cout << "Found duplicate document id " << document_id << '\n';
+    }
+    std::cout.flush();
+    search_server.RemoveDocuments(duplicate_ids);
+}
+
+}  // namespace
 
 void RemoveDuplicates(SearchServer& search_server) {
-	std::set<std::set<std::string_view>> doc_map;
-	for (auto it = search_server.begin(); it != search_server.end();)
-	{
-		std::set<std::string_view> check;
-		for (const auto& [word, freq] : search_server.GetWordFrequencies(*it))
-		{
-			check.insert(word);
-		} 
-		if (doc_map.count(check))
-		{
-			std::cout << "Found duplicate document id " << *it << std::endl;
-			search_server.RemoveDocument(*it++);
-		}
-		else
-		{
-			doc_map.insert(check);
-			++it;
-		}
-	}
-}
\ No newline at end of file
+    const std::vector<int> document_ids(search_server.begin(), search_server.end());
+    std::vector<const WordFrequencies*> documents(document_ids.size());
+    std::vector<Fingerprint> fingerprints(document_ids.size());
+    ThreadPool::GetDefault().ParallelFor(0, document_ids.size(), [&](size_t i) {
+        documents[i] = &search_server.GetWordFrequencies(document_ids[i]);
+        fingerprints[i] = GetFingerprint(*documents[i]);
+    });
+
+    // the first document of every set of words is kept, fingerprints of different sets may collide
+    std::unordered_multimap<Fingerprint, size_t, FingerprintHasher> kept_documents;
+    kept_documents.reserve(document_ids.size());
+    std::vector<int> duplicate_ids;
+    for (size_t i = 0; i < document_ids.size(); ++i) {
+        const auto [first, last] = kept_documents.equal_range(fingerprints[i]);
+        if (std::any_of(first, last, [&](const auto& kept) { return HaveSameWords(*documents[kept.second], *documents[i]); })) {
+            duplicate_ids.push_back(document_ids[i]);
+        }
+        else {
+            kept_documents.emplace(fingerprints[i], i);
+        }
+    }
+    RemoveFoundDuplicates(search_server, duplicate_ids);
+}
+
+void RemoveDuplicates(SearchServer& search_server, double min_similarity) {
+    if (!(min_similarity > 0.0 && min_similarity <= 1.0)) {
+        throw std::invalid_argument("min_similarity out of range");
+    }
+    if (min_similarity == 1.0) {
+        RemoveDuplicates(search_server);
+        return;
+    }
+
+    const int row_count = GetRowCount(min_similarity);
+    const size_t band_count = SIGNATURE_SIZE / row_count;
+    const std::vector<int> document_ids(search_server.begin(), search_server.end());
+    std::vector<const WordFrequencies*> documents(document_ids.size());
+    std::vector<uint64_t> band_keys(document_ids.size() * band_count);
+    ThreadPool::GetDefault().ParallelFor(0, document_ids.size(), [&](size_t i) {
+        documents[i] = &search_server.GetWordFrequencies(document_ids[i]);
+        GetBandKeys(*documents[i], row_count, &band_keys[i * band_count]);
+    });
+
+    // kept documents in buckets of band keys: the last entry of bucket and the previous entry of each
+    // entry, entry i * band_count + band belongs to document i
+    std::unordered_map<uint64_t, size_t> last_entries;
+    last_entries.reserve(band_keys.size());
+    std::vector<size_t> previous_entries(band_keys.size());
+    constexpr size_t NO_ENTRY = std::numeric_limits<size_t>::max();
+    // the document candidate was checked against, a candidate may share several bands
+    std::vector<size_t> checked_for(document_ids.size(), NO_ENTRY);
+    std::vector<int> duplicate_ids;
+    for (size_t i = 0; i < document_ids.size(); ++i) {
+        bool is_duplicate = false;
+        for (size_t entry = i * band_count; entry < (i + 1) * band_count && !is_duplicate; ++entry) {
+            const auto bucket = last_entries.find(band_keys[entry]);
+            if (bucket == last_entries.end()) {
+                continue;
+            }
+            for (size_t kept_entry = bucket->second; kept_entry != NO_ENTRY; kept_entry = previous_entries[kept_entry]) {
+                const size_t kept = kept_entry / band_count;
+                if (checked_for[kept] == i) {
+                    continue;
+                }
+                checked_for[kept] = i;
+                if (GetSimilarity(*documents[kept], *documents[i]) >= min_similarity) {
+                    is_duplicate = true;
+                    break;
+                }
+            }
+        }
+
+        if (is_duplicate) {
+            duplicate_ids.push_back(document_ids[i]);
+            continue;
+        }
+        for (size_t entry = i * band_count; entry < (i + 1) * band_count; ++entry) {
+            const auto [bucket, is_new] = last_entries.emplace(band_keys[entry], entry);
+            previous_entries[entry] = is_new ? NO_ENTRY : bucket->second;
+            bucket->second = entry;
+        }
+    }
+    RemoveFoundDuplicates(search_server, duplicate_ids);
+}
@@ -2,4 +2,13 @@
 
 #include "search_server.h"
 
-void RemoveDuplicates(SearchServer& search_server);
\ No newline at end of file
+// Removes documents having the same set of words as a document with smaller id.
+// Sets of words are compared by 128-bit fingerprints, and the sets are checked on a match.
+void RemoveDuplicates(SearchServer& search_server);
+
+// Removes near duplicates: documents whose sets of words have Jaccard similarity at least
+// min_similarity (0 < min_similarity <= 1) with a kept document of smaller id.
+// Candidates are found by MinHash LSH and the similarity is checked exactly, so there are
+// no false duplicates, and a pair of documents with similarity min_similarity is missed
+// with probability below 5% if min_similarity > 0.03 (more similar ones are missed even less).
+void RemoveDuplicates(SearchServer& search_server, double min_similarity);
@@ -1,15 +1,26 @@
 #include "request_queue.h"
 
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
 
-RequestQueue::RequestQueue(const SearchServer& search_server)
+RequestQueue::RequestQueue(const SearchServer& search_server, Clock::duration window, int bucket_count, TimeSource get_time)
     : search_server_(search_server)
+    , get_time_(std::move(get_time))
+    , start_time_(get_time_())
+    , bucket_duration_(bucket_count > 0 ? window / bucket_count : Clock::duration::zero())
+    , buckets_(std::max(bucket_count, 0))
 {
+    if (bucket_duration_ <= Clock::duration::zero()) {
+        throw std::invalid_argument("window is shorter than bucket_count ticks");
+    }
 }
 
 std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentStatus status) {
-    return AddFindRequest(raw_query,
-        [status]([[maybe_unused]] int document_id, DocumentStatus document_status, [[maybe_unused]] int rating)
-        { return document_status == status; });
+    // status overload of search filters documents by bitset of the status
+    auto documents = search_server_.FindTopDocuments(raw_query, status);
+    AddRequest(!documents.empty());
+    return documents;
 }
 
 std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query) {
@@ -17,5 +28,64 @@ std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query)
 }
 
 int RequestQueue::GetNoResultRequests() const {
-    return std::count(requests_.begin(), requests_.end(), false);
+    return static_cast<int>(GetStatistics().no_result_count);
+}
+
+RequestQueue::Statistics RequestQueue::GetStatistics() const {
+    const Clock::time_point now = get_time_();
+    const uint32_t period = GetPeriod(now);
+    Statistics statistics;
+    for (const Bucket& bucket : buckets_) {
+        statistics.request_count += GetCount(bucket.requests, period);
+        statistics.no_result_count += GetCount(bucket.no_results, period);
+    }
+
+    // the window starts with the oldest of its buckets and ends now, in the middle of the current one
+    const int64_t first_period = std::max<int64_t>(static_cast<int64_t>(period) - static_cast<int64_t>(buckets_.size()) + 1, 0);
+    const std::chrono::duration<double> covered = now - (start_time_ + first_period * bucket_duration_);
+    if (covered.count() > 0.0) {
+        statistics.queries_per_second = statistics.request_count / covered.count();
+    }
+    if (statistics.request_count > 0) {
+        statistics.no_result_rate = static_cast<double>(statistics.no_result_count) / statistics.request_count;
+    }
+    return statistics;
+}
+
+void RequestQueue::AddRequest(bool has_result) {
+    const uint32_t period = GetPeriod(get_time_());
+    Bucket& bucket = buckets_[period % buckets_.size()];
+    Increment(bucket.requests, period);
+    if (!has_result) {
+        Increment(bucket.no_results, period);
+    }
+}
+
+// periods are counted from creation of the queue, 32 bits are enough for years of minute buckets
+uint32_t RequestQueue::GetPeriod(Clock::time_point time) const {
+    return static_cast<uint32_t>(std::max<Clock::rep>((time - start_time_) / bucket_duration_, 0));
+}
+
+void RequestQueue::Increment(std::atomic<uint64_t>& counter, uint32_t period) {
+    uint64_t value = counter.load(std::memory_order_relaxed);
+    uint64_t next_value;
+    do {
+        const uint32_t counter_period = static_cast<uint32_t>(value >> 32);
+        if (counter_period == period) {
+            next_value = value + 1;
+        }
+        else if (static_cast<int32_t>(period - counter_period) > 0) {
+            next_value = static_cast<uint64_t>(period) << 32 | 1;
+        }
+        else {
+            // the bucket went on to the next round while the request was being processed, it's dropped
+            return;
+        }
+    } while (!counter.compare_exchange_weak(value, next_value, std::memory_order_relaxed));
+}
+
+uint64_t RequestQueue::GetCount(const std::atomic<uint64_t>& counter, uint32_t period) const {
+    const uint64_t value = counter.load(std::memory_order_relaxed);
+    const int64_t age = static_cast<int32_t>(period - static_cast<uint32_t>(value >> 32));
+    return age >= 0 && age < static_cast<int64_t>(buckets_.size()) ? value & 0xffffffffULL : 0;
 }
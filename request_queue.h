@@ -1,38 +1,68 @@
 #pragma once
 
-#include <algorithm>
-#include <deque>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
 #include <string>
 #include <vector>
+
+#include "document.h"
 #include "search_server.h"
 
+// Counts find requests and requests without results over the last window of time.
+// The window is a ring of buckets of equal duration, each request goes to the bucket of its time.
+// Counters of bucket are updated by CAS, so AddFindRequest may be called from many threads.
 class RequestQueue {
 public:
-    RequestQueue() = default;
-    explicit RequestQueue(const SearchServer& search_server);
+    using Clock = std::chrono::steady_clock;
+    // time of request, called concurrently from AddFindRequest
+    using TimeSource = std::function<Clock::time_point()>;
+
+    struct Statistics {
+        uint64_t request_count = 0;
+        uint64_t no_result_count = 0;
+        // over the window or the time since the queue was created if it's shorter
+        double queries_per_second = 0.0;
+        double no_result_rate = 0.0;
+    };
+
+    explicit RequestQueue(const SearchServer& search_server, Clock::duration window = std::chrono::hours(24),
+        int bucket_count = 1440, TimeSource get_time = Clock::now);
 
     template <typename DocumentPredicate>
     std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate);
     std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentStatus status);
     std::vector<Document> AddFindRequest(const std::string& raw_query);
+
     int GetNoResultRequests() const;
+    Statistics GetStatistics() const;
+
 private:
-    int time_ = 0;
-    const static int min_in_day_ = 1440;
-    std::deque<bool> requests_;
+    // counters are packed with the number of bucket period they belong to: period << 32 | count,
+    // the first request of the next period replaces the count instead of adding to it
+    struct Bucket {
+        std::atomic<uint64_t> requests = 0;
+        std::atomic<uint64_t> no_results = 0;
+    };
+
+    void AddRequest(bool has_result);
+    uint32_t GetPeriod(Clock::time_point time) const;
+    static void Increment(std::atomic<uint64_t>& counter, uint32_t period);
+    // count if counter belongs to one of bucket_count periods up to the given one
+    uint64_t GetCount(const std::atomic<uint64_t>& counter, uint32_t period) const;
+
     const SearchServer& search_server_;
+    const TimeSource get_time_;
+    const Clock::time_point start_time_;
+    const Clock::duration bucket_duration_;
+    std::vector<Bucket> buckets_;
 };
 
 template <typename DocumentPredicate>
 std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate)
 {
-    ++time_;
-    if (time_ > min_in_day_) {
-        requests_.pop_front();
-        --time_;
-    }
-
-    requests_.push_back(search_server_.FindTopDocuments(raw_query, document_predicate).size());
-
-    return search_server_.FindTopDocuments(raw_query, document_predicate);
+    auto documents = search_server_.FindTopDocuments(raw_query, document_predicate);
+    AddRequest(!documents.empty());
+    return documents;
 }
@@ -1,4 +1,5 @@
 #include "search_server.h"
+#include "varint.h"
 
 SearchServer::SearchServer(const std::string_view stop_words_text)
     : SearchServer(SplitIntoWords(stop_words_text))
@@ -13,35 +14,476 @@ SearchServer::SearchServer(const std::string& stop_words_text)
 void SearchServer::AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings) {
 
     if ((document_id < 0) ||
-        (documents_.count(document_id) > 0)) {
+        (document_id_to_ordinal_.count(document_id) > 0)) {
         throw std::invalid_argument("Invalid document_id");
     }
+    if (!IsValidStatus(status)) {
+        throw std::invalid_argument("Invalid document status");
+    }
+    // ordinals are int, compaction keeps them from growing with removed documents
+    if (ordinal_to_document_id_.size() >= static_cast<size_t>(std::numeric_limits<int>::max())) {
+        throw std::invalid_argument("Too many documents");
+    }
 
-    const auto words = SplitIntoWordsNoStop(document);
+    std::vector<std::string_view> words;
+    std::vector<uint32_t> positions;
+    const int ordinal = static_cast<int>(ordinal_to_document_id_.size());
+    // equal words go together and in order, so every one is counted at once and inserted at the end
+    if (are_positions_enabled_) {
+        SplitIntoWordsNoStop(document, words, positions);
+        SortWords(words, positions);
+        positions_.Resize(ordinal + 1);
+    }
+    else {
+        SplitIntoWordsNoStop(document, words);
+        std::sort(words.begin(), words.end());
+    }
     const double inv_word_count = 1.0 / words.size();
 
-    for (const auto word : words) {
-        auto it = words_.insert(std::string(word));
-        std::string_view word_sv = *(it.first);
-        word_to_document_freqs_[word_sv][document_id] += inv_word_count;
-        document_to_word_freqs_[document_id][word_sv] += inv_word_count;
+    index_.SetDocumentLength(ordinal, static_cast<int>(words.size()));
+    total_word_count_ += words.size();
+    auto word_freqs = std::make_shared<std::map<std::string_view, double>>();
+    for (auto first = words.begin(); first != words.end();) {
+        const auto last = std::find_if(first, words.end(), [first](std::string_view word) { return word != *first; });
+        const uint32_t term_count = static_cast<uint32_t>(last - first);
+        const int term_id = index_.AddTerm(*first);
+        word_freqs->emplace_hint(word_freqs->end(), index_.GetTerm(term_id), term_count * inv_word_count);
+        index_.AddPosting(term_id, ordinal, term_count);
+        if (are_positions_enabled_) {
+            positions_.AddPositions(ordinal, term_id, positions.data() + (first - words.begin()), term_count);
+        }
+        first = last;
     }
+    document_to_word_freqs_.push_back(std::move(word_freqs));
 
-    documents_.emplace(document_id, DocumentData{ ComputeAverageRating(ratings), status });
+    document_id_to_ordinal_.emplace(document_id, ordinal);
+    ordinal_to_document_id_.push_back(document_id);
+    document_ratings_.push_back(ComputeAverageRating(ratings));
+    document_statuses_.push_back(status);
+    status_ordinals_[static_cast<size_t>(status)].Insert(ordinal);
 
     document_ids_.insert(document_id);
+    ++generation_;
+    index_.Flush();
+}
+
+void SearchServer::AddDocuments(const std::vector<DocumentToAdd>& documents) {
+    std::unordered_set<int> batch_ids;
+    for (const DocumentToAdd& document : documents) {
+        if ((document.id < 0) ||
+            (document_id_to_ordinal_.count(document.id) > 0) ||
+            !batch_ids.insert(document.id).second) {
+            throw std::invalid_argument("Invalid document_id");
+        }
+        if (!IsValidStatus(document.status)) {
+            throw std::invalid_argument("Invalid document status");
+        }
+    }
+    if (documents.size() > static_cast<size_t>(std::numeric_limits<int>::max()) - ordinal_to_document_id_.size()) {
+        throw std::invalid_argument("Too many documents");
+    }
+
+    // documents of one chunk are handled by one task, their words are views into document texts
+    struct Chunk {
+        size_t first;
+        size_t last;
+        std::vector<int> word_counts;
+        std::vector<std::vector<std::pair<std::string_view, uint32_t>>> term_counts;
+        // positions of document words in order of term_counts, if they are enabled
+        std::vector<std::vector<uint32_t>> positions;
+        std::unordered_map<std::string_view, int> term_ids;
+        // (term_id, posting) split by term_id % term_shard_count
+        std::vector<std::vector<std::pair<int, InvertedIndex::Posting>>> postings;
+    };
+
+    ThreadPool& thread_pool = ThreadPool::GetDefault();
+    const size_t chunk_count = std::clamp<size_t>(documents.size() / MIN_INGEST_CHUNK_SIZE, 1, thread_pool.GetThreadCount() * 4);
+    const size_t term_shard_count = thread_pool.GetThreadCount() * 4;
+    std::vector<Chunk> chunks(chunk_count);
+    for (size_t i = 0; i < chunk_count; ++i) {
+        chunks[i].first = documents.size() * i / chunk_count;
+        chunks[i].last = documents.size() * (i + 1) / chunk_count;
+    }
+
+    // invalid word throws here, before the server is changed
+    thread_pool.ParallelFor(0, chunk_count, [&](size_t i) {
+        Chunk& chunk = chunks[i];
+        chunk.word_counts.resize(chunk.last - chunk.first);
+        chunk.term_counts.resize(chunk.last - chunk.first);
+        std::vector<std::string_view> words;
+        if (are_positions_enabled_) {
+            chunk.positions.resize(chunk.last - chunk.first);
+        }
+        for (size_t j = chunk.first; j < chunk.last; ++j) {
+            if (are_positions_enabled_) {
+                auto& positions = chunk.positions[j - chunk.first];
+                SplitIntoWordsNoStop(documents[j].text, words, positions);
+                SortWords(words, positions);
+            }
+            else {
+                SplitIntoWordsNoStop(documents[j].text, words);
+                std::sort(words.begin(), words.end());
+            }
+            chunk.word_counts[j - chunk.first] = static_cast<int>(words.size());
+            auto& term_counts = chunk.term_counts[j - chunk.first];
+            for (const std::string_view word : words) {
+                if (term_counts.empty() || term_counts.back().first != word) {
+                    term_counts.emplace_back(word, 0);
+                    chunk.term_ids.emplace(word, InvertedIndex::NO_TERM);
+                }
+                ++term_counts.back().second;
+            }
+        }
+    });
+
+    // dictionary is changed by one thread, every distinct word of the chunk is looked up once
+    for (Chunk& chunk : chunks) {
+        for (auto& [word, term_id] : chunk.term_ids) {
+            term_id = index_.AddTerm(word);
+        }
+    }
+
+    const int first_ordinal = static_cast<int>(ordinal_to_document_id_.size());
+    for (const Chunk& chunk : chunks) {
+        for (size_t j = chunk.first; j < chunk.last; ++j) {
+            index_.SetDocumentLength(first_ordinal + static_cast<int>(j), chunk.word_counts[j - chunk.first]);
+            total_word_count_ += chunk.word_counts[j - chunk.first];
+        }
+    }
+    document_to_word_freqs_.resize(first_ordinal + documents.size());
+    if (are_positions_enabled_) {
+        positions_.Resize(first_ordinal + documents.size());
+    }
+    thread_pool.ParallelFor(0, chunk_count, [&](size_t i) {
+        Chunk& chunk = chunks[i];
+        chunk.postings.resize(term_shard_count);
+        for (size_t j = chunk.first; j < chunk.last; ++j) {
+            const int ordinal = first_ordinal + static_cast<int>(j);
+            const double inv_word_count = 1.0 / chunk.word_counts[j - chunk.first];
+            auto document_word_freqs = std::make_shared<std::map<std::string_view, double>>();
+            size_t position_offset = 0;
+            // words are sorted, so every one is inserted at the end
+            for (const auto& [word, term_count] : chunk.term_counts[j - chunk.first]) {
+                const int term_id = chunk.term_ids.at(word);
+                document_word_freqs->emplace_hint(document_word_freqs->end(), index_.GetTerm(term_id), term_count * inv_word_count);
+                chunk.postings[term_id % term_shard_count].push_back({ term_id, { ordinal, term_count } });
+                if (are_positions_enabled_) {
+                    positions_.AddPositions(ordinal, term_id, chunk.positions[j - chunk.first].data() + position_offset, term_count);
+                    position_offset += term_count;
+                }
+            }
+            document_to_word_freqs_[ordinal] = std::move(document_word_freqs);
+        }
+        chunk.term_counts.clear();
+        chunk.positions.clear();
+    });
+
+    // chunks go in order of ordinals, so every posting is appended to the end of its list
+    thread_pool.ParallelFor(0, term_shard_count, [&](size_t shard) {
+        for (const Chunk& chunk : chunks) {
+            for (const auto& [term_id, posting] : chunk.postings[shard]) {
+                index_.AddPosting(term_id, posting.document_ordinal, posting.term_count);
+            }
+        }
+    });
+
+    for (const DocumentToAdd& document : documents) {
+        status_ordinals_[static_cast<size_t>(document.status)].Insert(static_cast<int>(ordinal_to_document_id_.size()));
+        document_id_to_ordinal_.emplace(document.id, static_cast<int>(ordinal_to_document_id_.size()));
+        ordinal_to_document_id_.push_back(document.id);
+        document_ratings_.push_back(ComputeAverageRating(document.ratings));
+        document_statuses_.push_back(document.status);
+        document_ids_.insert(document.id);
+    }
+    ++generation_;
+    index_.Flush();
+}
+
+void SearchServer::SaveSnapshot(const std::string& path) const {
+    SnapshotWriter writer(path);
+    writer.WriteString(SNAPSHOT_MAGIC);
+    writer.Write(SNAPSHOT_VERSION);
+    writer.Write(SNAPSHOT_BYTE_ORDER_MARK);
+
+    const std::vector<std::string_view> stop_words = GetSortedWords(stop_words_);
+    writer.Write<uint64_t>(stop_words.size());
+    for (const std::string_view word : stop_words) {
+        writer.WriteString(word);
+    }
+    writer.Write<uint8_t>(are_positions_enabled_);
+
+    // all ordinals are saved, removed documents stay tombstones of the index
+    std::vector<int32_t> statuses;
+    for (const DocumentStatus status : document_statuses_) {
+        statuses.push_back(static_cast<int32_t>(status));
+    }
+    writer.WriteArray(ordinal_to_document_id_);
+    writer.WriteArray(document_ratings_);
+    writer.WriteArray(statuses);
+
+    // words are numbered in sorted order, so loader appends them to the ends of sets and maps
+    const std::vector<std::string_view> words = GetSortedWords(index_.GetTerms());
+    std::vector<int> term_numbers(index_.GetTerms().GetIdLimit(), -1);
+    writer.Write<uint64_t>(words.size());
+    for (size_t i = 0; i < words.size(); ++i) {
+        writer.WriteString(words[i]);
+        term_numbers[index_.FindTerm(words[i])] = static_cast<int>(i);
+    }
+    index_.Save(writer, term_numbers);
+
+    // numbers and counts of words of every document in order of words, so loader builds word frequencies
+    // document by document instead of transposing posting lists. Removed documents have no words
+    std::vector<uint8_t> document_terms;
+    for (size_t ordinal = 0; ordinal < document_to_word_freqs_.size(); ++ordinal) {
+        if (index_.IsRemoved(static_cast<int>(ordinal))) {
+            WriteVarint(document_terms, 0);
+            continue;
+        }
+        const std::map<std::string_view, double>& word_freqs = *document_to_word_freqs_[ordinal];
+        const int document_length = index_.GetDocumentLength(static_cast<int>(ordinal));
+        WriteVarint(document_terms, static_cast<uint32_t>(word_freqs.size()));
+        int previous_number = 0;
+        for (const auto& [word, freq] : word_freqs) {
+            const int number = term_numbers[index_.FindTerm(word)];
+            WriteVarint(document_terms, static_cast<uint32_t>(number - previous_number));
+            WriteVarint(document_terms, static_cast<uint32_t>(std::lround(freq * document_length)));
+            previous_number = number;
+        }
+    }
+    writer.WriteAlignedArray(document_terms.data(), document_terms.size());
+
+    if (are_positions_enabled_) {
+        // positions of present postings of word one after another
+        std::vector<uint32_t> positions;
+        std::vector<uint32_t> document_positions;
+        for (const std::string_view word : words) {
+            const int term_id = index_.FindTerm(word);
+            positions.clear();
+            for (auto postings = index_.GetPostings(term_id); !postings.IsEnd(); postings.Next()) {
+                positions_.GetPositions(postings.GetOrdinal(), term_id, document_positions);
+                positions.insert(positions.end(), document_positions.begin(), document_positions.end());
+            }
+            writer.WriteArray(positions);
+        }
+    }
+    writer.Finish();
+}
+
+SearchServer SearchServer::LoadSnapshot(const std::string& path) {
+    // segments of index keep the file mapped
+    const auto file = std::make_shared<const MappedFile>(path);
+    SnapshotReader reader(file->GetData());
+    if ((reader.ReadString() != SNAPSHOT_MAGIC) ||
+        (reader.Read<uint32_t>() != SNAPSHOT_VERSION) ||
+        (reader.Read<uint32_t>() != SNAPSHOT_BYTE_ORDER_MARK)) {
+        throw std::invalid_argument("Unsupported snapshot format");
+    }
+
+    const uint64_t stop_word_count = reader.Read<uint64_t>();
+    std::vector<std::string_view> stop_words;
+    for (uint64_t i = 0; i < stop_word_count; ++i) {
+        stop_words.push_back(reader.ReadString());
+    }
+    SearchServer search_server(stop_words);
+    const uint8_t are_positions_enabled = reader.Read<uint8_t>();
+    if (are_positions_enabled > 1) {
+        throw std::invalid_argument("Unsupported snapshot format");
+    }
+    search_server.are_positions_enabled_ = are_positions_enabled;
+
+    std::vector<int> document_ids;
+    std::vector<int> ratings;
+    std::vector<int32_t> statuses;
+    reader.ReadArray(document_ids);
+    reader.ReadArray(ratings);
+    reader.ReadArray(statuses);
+    if ((ratings.size() != document_ids.size()) || (statuses.size() != document_ids.size())) {
+        throw std::invalid_argument("Invalid documents in snapshot");
+    }
+
+    // numbers of words become their term ids
+    const uint64_t term_count = reader.Read<uint64_t>();
+    std::string_view previous_word;
+    for (uint64_t i = 0; i < term_count; ++i) {
+        const std::string_view word = reader.ReadString();
+        if (word.empty() || !IsValidWord(word) || (i > 0 && previous_word >= word)) {
+            throw std::invalid_argument("Invalid word in snapshot");
+        }
+        previous_word = word;
+        search_server.index_.AddTerm(word);
+    }
+    search_server.index_.Load(reader, file, document_ids.size());
+
+    for (size_t ordinal = 0; ordinal < document_ids.size(); ++ordinal) {
+        if ((document_ids[ordinal] < 0) ||
+            (statuses[ordinal] < static_cast<int32_t>(DocumentStatus::ACTUAL)) ||
+            (statuses[ordinal] > static_cast<int32_t>(DocumentStatus::REMOVED))) {
+            throw std::invalid_argument("Invalid documents in snapshot");
+        }
+        search_server.document_statuses_.push_back(static_cast<DocumentStatus>(statuses[ordinal]));
+        if (search_server.index_.IsRemoved(static_cast<int>(ordinal))) {
+            continue;
+        }
+        if (!search_server.document_id_to_ordinal_.emplace(document_ids[ordinal], static_cast<int>(ordinal)).second) {
+            throw std::invalid_argument("Invalid documents in snapshot");
+        }
+        search_server.document_ids_.insert(document_ids[ordinal]);
+        search_server.status_ordinals_[statuses[ordinal]].Insert(static_cast<int>(ordinal));
+        search_server.total_word_count_ += search_server.index_.GetDocumentLength(static_cast<int>(ordinal));
+    }
+    search_server.ordinal_to_document_id_ = std::move(document_ids);
+    search_server.document_ratings_ = std::move(ratings);
+    if (are_positions_enabled) {
+        search_server.positions_.Resize(search_server.ordinal_to_document_id_.size());
+    }
+
+    // word frequencies of present documents, words go in sorted order, so every one is inserted at the end of map.
+    // Documents of every word are counted to be checked against posting lists
+    size_t document_terms_size = 0;
+    const uint8_t* document_terms = reader.ReadAlignedArray<uint8_t>(document_terms_size);
+    const uint8_t* const document_terms_end = document_terms + document_terms_size;
+    const auto read_value = [&document_terms, document_terms_end]() {
+        uint32_t value = 0;
+        if (!ReadVarint(document_terms, document_terms_end, value)) {
+            throw std::invalid_argument("Invalid words of documents in snapshot");
+        }
+        return value;
+    };
+    std::vector<size_t> document_freqs(term_count);
+    search_server.document_to_word_freqs_.resize(search_server.ordinal_to_document_id_.size());
+    for (size_t ordinal = 0; ordinal < search_server.ordinal_to_document_id_.size(); ++ordinal) {
+        const uint32_t document_term_count = read_value();
+        if (search_server.index_.IsRemoved(static_cast<int>(ordinal))) {
+            if (document_term_count != 0) {
+                throw std::invalid_argument("Invalid words of documents in snapshot");
+            }
+            continue;
+        }
+        const int document_length = search_server.index_.GetDocumentLength(static_cast<int>(ordinal));
+        const double inverse_document_length = document_length > 0 ? 1.0 / document_length : 0.0;
+        auto word_freqs = std::make_shared<std::map<std::string_view, double>>();
+        uint64_t number = 0;
+        uint64_t word_count = 0;
+        for (uint32_t i = 0; i < document_term_count; ++i) {
+            const uint32_t number_gap = read_value();
+            const uint32_t count = read_value();
+            number += number_gap;
+            word_count += count;
+            if (((i > 0) && (number_gap == 0)) || (number >= term_count) || (count == 0) ||
+                (word_count > static_cast<uint64_t>(document_length))) {
+                throw std::invalid_argument("Invalid words of documents in snapshot");
+            }
+            ++document_freqs[number];
+            word_freqs->emplace_hint(word_freqs->end(), search_server.index_.GetTerm(static_cast<int>(number)), count * inverse_document_length);
+        }
+        if (word_count != static_cast<uint64_t>(document_length)) {
+            throw std::invalid_argument("Invalid words of documents in snapshot");
+        }
+        search_server.document_to_word_freqs_[ordinal] = std::move(word_freqs);
+    }
+    // words without documents are removed from dictionary, so every saved one has some
+    for (int term_id = 0; term_id < static_cast<int>(term_count); ++term_id) {
+        if ((document_freqs[term_id] == 0) || (document_freqs[term_id] != search_server.index_.GetDocumentFreq(term_id))) {
+            throw std::invalid_argument("Invalid postings in snapshot");
+        }
+    }
+    if (document_terms != document_terms_end) {
+        throw std::invalid_argument("Invalid words of documents in snapshot");
+    }
+
+    // positions of present documents go by word in order of posting lists
+    std::vector<uint32_t> positions;
+    for (int term_id = 0; are_positions_enabled && (term_id < static_cast<int>(term_count)); ++term_id) {
+        reader.ReadArray(positions);
+        size_t position_offset = 0;
+        for (auto postings = search_server.index_.GetPostings(term_id); !postings.IsEnd(); postings.Next()) {
+            const uint32_t term_count_of_document = postings.GetTermCount();
+            if ((positions.size() - position_offset < term_count_of_document) ||
+                !std::is_sorted(positions.begin() + position_offset, positions.begin() + position_offset + term_count_of_document, std::less_equal<>())) {
+                throw std::invalid_argument("Invalid positions in snapshot");
+            }
+            search_server.positions_.AddPositions(postings.GetOrdinal(), term_id, positions.data() + position_offset, term_count_of_document);
+            position_offset += term_count_of_document;
+        }
+        if (position_offset != positions.size()) {
+            throw std::invalid_argument("Invalid positions in snapshot");
+        }
+    }
+    if (!reader.IsEnd()) {
+        throw std::invalid_argument("Unexpected data at the end of snapshot");
+    }
+    return search_server;
+}
+
+std::string SearchServer::NormalizeQuery(const std::string_view raw_query) const {
+    const auto query = ParseQuery(std::execution::seq, raw_query);
+    std::string result;
+    for (const std::string_view word : query.plus_words) {
+        result.append(word).push_back(' ');
+    }
+    for (const std::string_view word : query.minus_words) {
+        result.append("-").append(word).push_back(' ');
+    }
+    for (const std::string_view word : query.required_words) {
+        result.append("+").append(word).push_back(' ');
+    }
+    // phrases and NEAR pairs change results, so they are kept in sorted order with offsets of words
+    std::vector<std::string> operators;
+    for (const Phrase& phrase : query.phrases) {
+        std::string& text = operators.emplace_back("\"");
+        for (size_t i = 0; i < phrase.words.size(); ++i) {
+            text.append(i > 0 ? " " : "").append(phrase.words[i]).append(":").append(std::to_string(phrase.offsets[i]));
+        }
+        text.push_back('"');
+    }
+    for (const Proximity& proximity : query.proximities) {
+        operators.push_back(std::string(proximity.lhs) + " NEAR/" + std::to_string(proximity.distance) + " " + std::string(proximity.rhs));
+    }
+    std::sort(operators.begin(), operators.end());
+    for (const std::string& text : operators) {
+        result.append(text).push_back(' ');
+    }
+    return result;
+}
+
+uint64_t SearchServer::GetGeneration() const {
+    return generation_;
+}
+
+void SearchServer::SetRetrievalMode(RetrievalMode mode) {
+    retrieval_mode_ = mode;
+}
+
+RetrievalMode SearchServer::GetRetrievalMode() const {
+    return retrieval_mode_;
+}
+
+void SearchServer::SetPositionsEnabled(bool enabled) {
+    if (!ordinal_to_document_id_.empty()) {
+        throw std::invalid_argument("Positions are switched before documents are added");
+    }
+    are_positions_enabled_ = enabled;
+}
+
+bool SearchServer::ArePositionsEnabled() const {
+    return are_positions_enabled_;
+}
+
+void SearchServer::Flush() {
+    index_.Flush(true);
+    index_.WaitMerges();
 }
 
-std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(std::execution::seq, raw_query, status);
+size_t SearchServer::GetSegmentCount() const {
+    return index_.GetSegmentCount();
 }
 
-std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query) const {
-    return FindTopDocuments(std::execution::seq, raw_query);
+size_t SearchServer::GetWordArenaSize() const {
+    return index_.GetTerms().GetArenaSize();
 }
 
 int SearchServer::GetDocumentCount() const {
-    return documents_.size();
+    return document_id_to_ordinal_.size();
 }
 
 std::set<int>::const_iterator SearchServer::begin() const {
@@ -55,10 +497,10 @@ std::set<int>::const_iterator SearchServer::end() const {
 const std::map<std::string_view, double>&
 SearchServer::GetWordFrequencies(int document_id) const {
     static std::map<std::string_view, double> empty_map;
-    auto it = document_to_word_freqs_.find(document_id);
-    if (it != document_to_word_freqs_.end())
+    const int ordinal = FindDocumentOrdinal(document_id);
+    if (ordinal >= 0)
     {
-        return ((*it).second);
+        return *document_to_word_freqs_[ordinal];
     }
     else
     {
@@ -72,37 +514,40 @@ void SearchServer::RemoveDocument(int document_id) {
 
 // execution sequenced_policy
 void SearchServer::RemoveDocument(const std::execution::sequenced_policy& policy, int document_id) {
-    // remove from document_ids_
-    document_ids_.erase(document_id);
-    // remove from documents_
-    documents_.erase(document_id);
-    // remove from word_to_document_freqs_
-    for_each(policy, word_to_document_freqs_.begin(),
-        word_to_document_freqs_.end(),
-        [document_id](auto& p)
-        { p.second.erase(document_id); }
-    );//*/
-    // remove from document_to_word_freqs_
-    document_to_word_freqs_.erase(document_id);
+    RemoveDocuments(policy, { document_id });
 }
 
 // execution parallel_policy
 void SearchServer::RemoveDocument(const std::execution::parallel_policy& policy, int document_id) {
-    // remove from document_ids_
-    document_ids_.erase(document_id);
-    // remove from documents_
-    documents_.erase(document_id);
-    // remove from word_to_document_freqs_
-    const std::map<std::string_view, double>& m = GetWordFrequencies(document_id);
-    std::vector<std::string_view> v(m.size());
-    transform(policy, m.begin(), m.end(), v.begin(),
-        [](auto& p) { return p.first; });
-    for_each(policy, v.begin(), v.end(),
-        [this, document_id](auto& word)
-        { word_to_document_freqs_[word].erase(document_id); }
-    );
-    // remove from document_to_word_freqs_
-    document_to_word_freqs_.erase(document_id);
+    RemoveDocuments(policy, { document_id });
+}
+
+void SearchServer::RemoveDocuments(const std::vector<int>& document_ids) {
+    RemoveDocuments(std::execution::seq, document_ids);
+}
+
+// execution sequenced_policy
+void SearchServer::RemoveDocuments(const std::execution::sequenced_policy& policy, const std::vector<int>& document_ids) {
+    const auto ordinals = GetExistingOrdinals(document_ids);
+    const auto removed_term_counts = GetRemovedTermCounts(ordinals);
+    index_.RemoveDocuments(ordinals);
+    for (const auto& [term_id, count] : removed_term_counts) {
+        index_.DecrementDocumentFreq(term_id, count);
+    }
+    ReleaseRemovedDocuments(ordinals, removed_term_counts);
+    index_.Flush();
+    if (index_.NeedsCompaction()) {
+        CompactOrdinals();
+    }
+    if (index_.GetTerms().NeedsCompaction()) {
+        CompactWords();
+    }
+}
+
+// execution parallel_policy
+void SearchServer::RemoveDocuments(const std::execution::parallel_policy& policy, const std::vector<int>& document_ids) {
+    // posting lists are not rewritten, only counters of removed words change, so there is nothing to split
+    RemoveDocuments(std::execution::seq, document_ids);
 }
 
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::string_view raw_query, int document_id) const {
@@ -113,21 +558,22 @@ std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDoc
 // execution sequenced_policy
 std::tuple<std::vector<std::string_view>, DocumentStatus>
 SearchServer::MatchDocument(const std::execution::sequenced_policy& policy, const std::string_view raw_query, int document_id) const {
-    if ((document_id < 0) || (documents_.count(document_id) == 0)) {
+    const int ordinal = FindDocumentOrdinal(document_id);
+    if (ordinal < 0) {
         throw std::invalid_argument("document_id out of range");
     }
 
     const auto query = SearchServer::ParseQuery(std::execution::seq, raw_query);
     std::vector<std::string_view> matched_words;
-    const std::map<std::string_view, double>& word_freq = GetWordFrequencies(document_id);
+    const std::map<std::string_view, double>& word_freq = *document_to_word_freqs_[ordinal];
 
     bool is_minus = any_of(//policy,
         query.minus_words.begin(), query.minus_words.end(),
         [&word_freq](const auto& word) { return word_freq.count(word); }
     );
-    if (is_minus)
+    if (is_minus || !HasRequiredWords(query, ordinal))
     {
-        return { {}, documents_.at(document_id).status };
+        return { std::vector<std::string_view>{}, document_statuses_[ordinal] };
     }
 
     copy_if(//policy,
@@ -142,12 +588,13 @@ SearchServer::MatchDocument(const std::execution::sequenced_policy& policy, cons
     auto last = unique(matched_words.begin(), matched_words.end());
     matched_words.erase(last, matched_words.end()); //*/
 
-    return { matched_words, documents_.at(document_id).status };
+    return { matched_words, document_statuses_[ordinal] };
 }
 
 // execution parallel_policy
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::execution::parallel_policy& policy, const std::string_view raw_query, int document_id) const {
-    if ((document_id < 0) || (documents_.count(document_id) == 0)) {
+    const int ordinal = FindDocumentOrdinal(document_id);
+    if (ordinal < 0) {
         throw std::invalid_argument("document_id out of range");
     }
 
@@ -155,15 +602,15 @@ std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDoc
     std::vector<std::string_view> matched_words;
     matched_words.reserve(query.plus_words.size());
 
-    const std::map<std::string_view, double>& word_freq = GetWordFrequencies(document_id);
+    const std::map<std::string_view, double>& word_freq = *document_to_word_freqs_[ordinal];
 
     bool is_minus = any_of(//policy,
         query.minus_words.begin(), query.minus_words.end(),
         [&word_freq](const auto& word) { return word_freq.count(word); }
     );
-    if (is_minus)
+    if (is_minus || !HasRequiredWords(query, ordinal))
     {
-        return { {}, documents_.at(document_id).status };
+        return { std::vector<std::string_view>{}, document_statuses_[ordinal] };
     }
 
     copy_if(//policy,
@@ -178,11 +625,185 @@ std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDoc
     auto last = unique(matched_words.begin(), matched_words.end());
     matched_words.erase(last, matched_words.end()); //*/
 
-    return { matched_words, documents_.at(document_id).status };
+    return { matched_words, document_statuses_[ordinal] };
+}
+
+std::vector<PhraseMatch> SearchServer::MatchPhrases(const std::string_view raw_query, int document_id) const {
+    const int ordinal = FindDocumentOrdinal(document_id);
+    if (ordinal < 0) {
+        throw std::invalid_argument("document_id out of range");
+    }
+
+    const auto query = ParseQuery(std::execution::seq, raw_query);
+    const std::map<std::string_view, double>& word_freq = *document_to_word_freqs_[ordinal];
+    if (std::any_of(query.minus_words.begin(), query.minus_words.end(), [&word_freq](std::string_view word) { return word_freq.count(word); }) ||
+        !std::all_of(query.required_words.begin(), query.required_words.end(), [&word_freq](std::string_view word) { return word_freq.count(word); })) {
+        return {};
+    }
+    std::vector<PhraseTerm> terms;
+    std::vector<size_t> phrase_ends;
+    if (!MakePhraseTerms(query, terms, phrase_ends)) {
+        return {};
+    }
+
+    std::vector<PhraseMatch> matches;
+    std::vector<std::vector<uint32_t>> positions;
+    for (size_t i = 0; i < query.phrases.size(); ++i) {
+        PhraseMatch& match = matches.emplace_back();
+        // views into dictionary outlive the query
+        for (const std::string_view word : query.phrases[i].words) {
+            match.words.push_back(index_.GetTerm(index_.FindTerm(word)));
+        }
+        if (!FindPhrase(ordinal, terms.data() + (i > 0 ? phrase_ends[i - 1] : 0), terms.data() + phrase_ends[i], positions, &match.positions)) {
+            return {};
+        }
+    }
+    return matches;
+}
+
+int SearchServer::FindDocumentOrdinal(int document_id) const {
+    auto it = document_id_to_ordinal_.find(document_id);
+    return it == document_id_to_ordinal_.end() ? -1 : it->second;
+}
+
+size_t SearchServer::GetShardCount() const {
+    const size_t thread_count = ThreadPool::GetDefault().GetThreadCount();
+    const size_t ordinal_count = ordinal_to_document_id_.size();
+    return std::clamp<size_t>(ordinal_count / MIN_SHARD_SIZE, 1, thread_count * 4);
+}
+
+std::pair<int, int> SearchServer::GetShardRange(size_t shard, size_t shard_count) const {
+    const int64_t ordinal_count = static_cast<int64_t>(ordinal_to_document_id_.size());
+    return { static_cast<int>(ordinal_count * shard / shard_count), static_cast<int>(ordinal_count * (shard + 1) / shard_count) };
+}
+
+std::vector<int> SearchServer::GetExistingOrdinals(const std::vector<int>& document_ids) const {
+    std::vector<int> ordinals;
+    ordinals.reserve(document_ids.size());
+    for (const int document_id : document_ids) {
+        const int ordinal = FindDocumentOrdinal(document_id);
+        if (ordinal >= 0) {
+            ordinals.push_back(ordinal);
+        }
+    }
+    std::sort(ordinals.begin(), ordinals.end());
+    ordinals.erase(std::unique(ordinals.begin(), ordinals.end()), ordinals.end());
+    return ordinals;
+}
+
+std::vector<std::pair<int, size_t>> SearchServer::GetRemovedTermCounts(const std::vector<int>& ordinals) const {
+    // only words of removed documents are touched, not the whole dictionary
+    std::unordered_map<int, size_t> term_counts;
+    for (const int ordinal : ordinals) {
+        for (const auto& [word, _] : *document_to_word_freqs_[ordinal]) {
+            ++term_counts[index_.FindTerm(word)];
+        }
+    }
+    return { term_counts.begin(), term_counts.end() };
+}
+
+void SearchServer::ReleaseRemovedDocuments(const std::vector<int>& ordinals, const std::vector<std::pair<int, size_t>>& removed_term_counts) {
+    // words left without documents are dropped from dictionary
+    for (const auto& [term_id, _] : removed_term_counts) {
+        if (index_.GetDocumentFreq(term_id) == 0) {
+            index_.RemoveTerm(term_id);
+        }
+    }
+    // ordinals are not reused, only their word frequencies are released
+    for (const int ordinal : ordinals) {
+        const int document_id = ordinal_to_document_id_[ordinal];
+        document_ids_.erase(document_id);
+        document_id_to_ordinal_.erase(document_id);
+        status_ordinals_[static_cast<size_t>(document_statuses_[ordinal])].Erase(ordinal);
+        total_word_count_ -= index_.GetDocumentLength(ordinal);
+        document_to_word_freqs_[ordinal].reset();
+        if (are_positions_enabled_) {
+            positions_.RemoveDocument(ordinal);
+        }
+    }
+    if (!ordinals.empty()) {
+        ++generation_;
+    }
+}
+
+void SearchServer::CompactOrdinals() {
+    const std::vector<int> new_ordinals = index_.CompactOrdinals();
+    const size_t document_count = document_id_to_ordinal_.size();
+    std::vector<int> ordinal_to_document_id(document_count);
+    std::vector<int> document_ratings(document_count);
+    std::vector<DocumentStatus> document_statuses(document_count);
+    std::vector<std::shared_ptr<const std::map<std::string_view, double>>> document_to_word_freqs(document_count);
+    std::array<OrdinalSet, static_cast<size_t>(DocumentStatus::REMOVED) + 1> status_ordinals;
+    for (size_t ordinal = 0; ordinal < new_ordinals.size(); ++ordinal) {
+        const int new_ordinal = new_ordinals[ordinal];
+        if (new_ordinal < 0) {
+            continue;
+        }
+        ordinal_to_document_id[new_ordinal] = ordinal_to_document_id_[ordinal];
+        document_ratings[new_ordinal] = document_ratings_[ordinal];
+        document_statuses[new_ordinal] = document_statuses_[ordinal];
+        document_to_word_freqs[new_ordinal] = std::move(document_to_word_freqs_[ordinal]);
+        status_ordinals[static_cast<size_t>(document_statuses_[ordinal])].Insert(new_ordinal);
+    }
+    for (auto& [document_id, ordinal] : document_id_to_ordinal_) {
+        ordinal = new_ordinals[ordinal];
+    }
+    ordinal_to_document_id_ = std::move(ordinal_to_document_id);
+    document_ratings_ = std::move(document_ratings);
+    document_statuses_ = std::move(document_statuses);
+    document_to_word_freqs_ = std::move(document_to_word_freqs);
+    status_ordinals_ = std::move(status_ordinals);
+    if (are_positions_enabled_) {
+        positions_.RenumberDocuments(new_ordinals, document_count);
+    }
+    ++generation_;
+}
+
+void SearchServer::CompactWords() {
+    // the copy keeps old bytes until all views into them are replaced
+    const TermDictionary old_words = index_.GetTerms();
+    index_.CompactTerms();
+    for (auto& word_freqs : document_to_word_freqs_) {
+        if (!word_freqs) {
+            continue;
+        }
+        auto compacted_word_freqs = std::make_shared<std::map<std::string_view, double>>();
+        for (const auto& [word, freq] : *word_freqs) {
+            compacted_word_freqs->emplace_hint(compacted_word_freqs->end(), index_.GetTerm(index_.FindTerm(word)), freq);
+        }
+        word_freqs = std::move(compacted_word_freqs);
+    }
+}
+
+TermDictionary SearchServer::MakeStopWords(const std::set<std::string, std::less<>>& stop_words) {
+    if (!all_of(stop_words.begin(), stop_words.end(), IsValidWord)) {
+        throw std::invalid_argument("Some of stop words are invalid");
+    }
+    TermDictionary dictionary;
+    for (const std::string& word : stop_words) {
+        dictionary.Add(word);
+    }
+    return dictionary;
+}
+
+std::vector<std::string_view> SearchServer::GetSortedWords(const TermDictionary& words) {
+    std::vector<std::string_view> sorted_words;
+    sorted_words.reserve(words.GetSize());
+    for (int term_id = 0; term_id < words.GetIdLimit(); ++term_id) {
+        if (!words.GetWord(term_id).empty()) {
+            sorted_words.push_back(words.GetWord(term_id));
+        }
+    }
+    std::sort(sorted_words.begin(), sorted_words.end());
+    return sorted_words;
 }
 
 bool SearchServer::IsStopWord(const std::string_view word) const {
-    return stop_words_.count(word) > 0;
+    return stop_words_.Find(word) != TermDictionary::NO_TERM;
+}
+
+bool SearchServer::IsValidStatus(DocumentStatus status) {
+    return status >= DocumentStatus::ACTUAL && status <= DocumentStatus::REMOVED;
 }
 
 bool SearchServer::IsValidWord(const std::string_view word) {
@@ -192,18 +813,49 @@ bool SearchServer::IsValidWord(const std::string_view word) {
         });
 }
 
-std::vector<std::string_view> SearchServer::SplitIntoWordsNoStop(const std::string_view text) const {
-    std::vector<std::string_view> words;
-    for (const auto word : SplitIntoWords(text)) {
-        if (!IsValidWord(word)) {
-            throw std::invalid_argument(
-                "Word " + std::string(word) + " is invalid");
-        }
-        if (!IsStopWord(word) && word.size() > 0) {
-            words.push_back(word);
+void SearchServer::SplitIntoWordsNoStop(const std::string_view text, std::vector<std::string_view>& words) const {
+    if (!SplitIntoWords(text, words)) {
+        // control characters don't separate words, so one of them has it
+        const auto invalid_word = std::find_if_not(words.begin(), words.end(), IsValidWord);
+        throw std::invalid_argument(
+            "Word " + std::string(*invalid_word) + " is invalid");
+    }
+    if (stop_words_.GetSize() > 0) {
+        words.erase(std::remove_if(words.begin(), words.end(),
+            [this](const std::string_view word) {
+                return IsStopWord(word);
+            }), words.end());
+    }
+}
+
+void SearchServer::SplitIntoWordsNoStop(const std::string_view text, std::vector<std::string_view>& words, std::vector<uint32_t>& positions) const {
+    if (!SplitIntoWords(text, words)) {
+        const auto invalid_word = std::find_if_not(words.begin(), words.end(), IsValidWord);
+        throw std::invalid_argument(
+            "Word " + std::string(*invalid_word) + " is invalid");
+    }
+    positions.clear();
+    size_t word_count = 0;
+    for (size_t position = 0; position < words.size(); ++position) {
+        if (!IsStopWord(words[position])) {
+            words[word_count++] = words[position];
+            positions.push_back(static_cast<uint32_t>(position));
         }
     }
-    return words;
+    words.resize(word_count);
+}
+
+void SearchServer::SortWords(std::vector<std::string_view>& words, std::vector<uint32_t>& positions) {
+    thread_local std::vector<std::pair<std::string_view, uint32_t>> word_positions;
+    word_positions.clear();
+    for (size_t i = 0; i < words.size(); ++i) {
+        word_positions.emplace_back(words[i], positions[i]);
+    }
+    std::sort(word_positions.begin(), word_positions.end());
+    for (size_t i = 0; i < words.size(); ++i) {
+        words[i] = word_positions[i].first;
+        positions[i] = word_positions[i].second;
+    }
 }
 
 int SearchServer::ComputeAverageRating(const std::vector<int>& ratings) {
@@ -213,8 +865,18 @@ int SearchServer::ComputeAverageRating(const std::vector<int>& ratings) {
     return std::accumulate(ratings.begin(), ratings.end(), 0) / static_cast<int>(ratings.size());
 }
 
-double SearchServer::ComputeWordInverseDocumentFreq(const std::string_view word) const {
-    return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+TermStatistics SearchServer::GetTermStatistics(int term_id) const {
+    const size_t document_count = document_ids_.size();
+    return { document_count, index_.GetDocumentFreq(term_id),
+        document_count > 0 ? static_cast<double>(total_word_count_) / document_count : 0.0,
+        index_.GetInverseDocumentFreq(term_id, document_count), index_.GetSmoothedInverseDocumentFreq(term_id, document_count) };
+}
+
+void SearchServer::SplitIntoQueryWords(const std::string_view text, std::vector<std::string_view>& words) {
+    if (!SplitIntoWords(text, words)) {
+        const auto invalid_word = std::find_if_not(words.begin(), words.end(), IsValidWord);
+        throw std::invalid_argument("Query word " + std::string(*invalid_word) + " is invalid");
+    }
 }
 
 SearchServer::QueryWord SearchServer::ParseQueryWord(const std::string_view text) const {
@@ -224,29 +886,160 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(const std::string_view text
 
     std::string_view word = text;
     bool is_minus = false;
+    bool is_required = false;
     if (word[0] == '-') {
         is_minus = true;
         word = word.substr(1);
     }
-    if (word.empty() || word[0] == '-' || !IsValidWord(word)) {
+    else if (word[0] == '+') {
+        is_required = true;
+        word = word.substr(1);
+    }
+    if (word.empty() || word[0] == '-' || word[0] == '+') {
         throw std::invalid_argument("Query word " + std::string(text) + " is invalid");
     }
-    return { word, is_minus, IsStopWord(word) };
+    return { word, is_minus, IsStopWord(word), is_required };
 }
 
-SearchServer::Query SearchServer::ParseQuery(const std::execution::sequenced_policy& policy, const std::string_view text) const {
-    Query result;
-    for (const auto word : SplitIntoWords(text)) {
-        const auto query_word = ParseQueryWord(word);
-        if (!query_word.is_stop) {
-            if (query_word.is_minus) {
-                result.minus_words.push_back(query_word.data); // 
+bool SearchServer::ParseProximityOperator(const std::string_view word, uint32_t& distance) {
+    constexpr std::string_view prefix = "NEAR/";
+    if (word.substr(0, prefix.size()) != prefix) {
+        return false;
+    }
+    const std::string_view digits = word.substr(prefix.size());
+    uint64_t value = 0;
+    for (const char c : digits) {
+        if (c < '0' || c > '9' || value > std::numeric_limits<uint32_t>::max() / 10) {
+            throw std::invalid_argument("Query word " + std::string(word) + " is invalid");
+        }
+        value = value * 10 + (c - '0');
+    }
+    if (digits.empty() || value == 0 || value > std::numeric_limits<uint32_t>::max()) {
+        throw std::invalid_argument("Query word " + std::string(word) + " is invalid");
+    }
+    distance = static_cast<uint32_t>(value);
+    return true;
+}
+
+// "words in quotes" is a phrase, lhs NEAR/k rhs joins two plain plus words, +word is required
+void SearchServer::ParseQueryWords(const std::string_view text, std::vector<std::string_view>& words, Query& result) const {
+    result.plus_words.clear();
+    result.minus_words.clear();
+    result.required_words.clear();
+    result.phrases.clear();
+    result.proximities.clear();
+    SplitIntoQueryWords(text, words);
+
+    bool is_phrase = false;
+    // number of the word in phrase, stop words are counted
+    uint32_t phrase_offset = 0;
+    // previous plain plus word for NEAR, empty after other words
+    QueryWord previous_word{};
+    // NEAR waits for its right word
+    bool is_proximity = false;
+    uint32_t distance = 0;
+    for (const std::string_view token : words) {
+        std::string_view word = token;
+        bool is_phrase_end = false;
+        if (!is_phrase && word[0] == '"') {
+            is_phrase = true;
+            phrase_offset = 0;
+            result.phrases.emplace_back();
+            word.remove_prefix(1);
+        }
+        if (is_phrase && !word.empty() && word.back() == '"') {
+            is_phrase_end = true;
+            word.remove_suffix(1);
+        }
+
+        if (!word.empty()) {
+            if (is_phrase) {
+                if (is_proximity) {
+                    throw std::invalid_argument("NEAR is not between two plus words");
+                }
+                const auto query_word = ParseQueryWord(word);
+                if (query_word.is_minus) {
+                    throw std::invalid_argument("Query word " + std::string(token) + " is invalid in phrase");
+                }
+                if (!query_word.is_stop) {
+                    result.phrases.back().words.push_back(query_word.data);
+                    result.phrases.back().offsets.push_back(phrase_offset);
+                    result.plus_words.push_back(query_word.data);
+                }
+                ++phrase_offset;
+                previous_word = {};
+            }
+            else if (ParseProximityOperator(word, distance)) {
+                if (is_proximity || previous_word.data.empty()) {
+                    throw std::invalid_argument("NEAR is not between two plus words");
+                }
+                is_proximity = true;
+            }
+            else {
+                const auto query_word = ParseQueryWord(word);
+                if (is_proximity) {
+                    if (query_word.is_minus) {
+                        throw std::invalid_argument("NEAR is not between two plus words");
+                    }
+                    // stop words are not indexed, so there is nothing to be near
+                    if (!query_word.is_stop && !previous_word.is_stop) {
+                        result.proximities.push_back({ previous_word.data, query_word.data, distance });
+                    }
+                    is_proximity = false;
+                }
+                if (!query_word.is_stop) {
+                    if (query_word.is_minus) {
+                        result.minus_words.push_back(query_word.data);
+                    }
+                    else {
+                        result.plus_words.push_back(query_word.data);
+                    }
+                    if (query_word.is_required) {
+                        result.required_words.push_back(query_word.data);
+                    }
+                }
+                previous_word = query_word.is_minus ? QueryWord{} : query_word;
+            }
+        }
+
+        if (is_phrase_end) {
+            Phrase& phrase = result.phrases.back();
+            if (phrase_offset == 0) {
+                throw std::invalid_argument("Query phrase is empty");
+            }
+            // a phrase of one word is the plain word
+            if (phrase.words.size() < 2) {
+                result.phrases.pop_back();
             }
             else {
-                result.plus_words.push_back(query_word.data); //
+                const uint32_t first_offset = phrase.offsets.front();
+                for (uint32_t& offset : phrase.offsets) {
+                    offset -= first_offset;
+                }
             }
+            is_phrase = false;
         }
     }
+    if (is_phrase) {
+        throw std::invalid_argument("Query phrase has no closing quote");
+    }
+    if (is_proximity) {
+        throw std::invalid_argument("NEAR is not between two plus words");
+    }
+    if (result.HasPositions() && !are_positions_enabled_) {
+        throw std::invalid_argument("Phrases and NEAR need positions of words");
+    }
+}
+
+SearchServer::Query SearchServer::ParseQuery(const std::execution::sequenced_policy& policy, const std::string_view text) const {
+    Query result;
+    std::vector<std::string_view> words;
+    ParseQuery(text, words, result);
+    return result;
+}
+
+void SearchServer::ParseQuery(const std::string_view text, std::vector<std::string_view>& words, Query& result) const {
+    ParseQueryWords(text, words, result);
 
     // sort -> unique -> erase is here for this version ParseQuery
     sort(result.plus_words.begin(), result.plus_words.end());
@@ -255,26 +1048,213 @@ SearchServer::Query SearchServer::ParseQuery(const std::execution::sequenced_pol
     sort(result.minus_words.begin(), result.minus_words.end());
     last = unique(result.minus_words.begin(), result.minus_words.end());
     result.minus_words.erase(last, result.minus_words.end());
-
-    return result;
+    sort(result.required_words.begin(), result.required_words.end());
+    last = unique(result.required_words.begin(), result.required_words.end());
+    result.required_words.erase(last, result.required_words.end());
 }
 
 SearchServer::Query SearchServer::ParseQuery(const std::execution::parallel_policy& policy, const std::string_view text) const {
     Query result;
-    for (const std::string_view word : SplitIntoWords(text)) {
-        const auto query_word = ParseQueryWord(word);
-        if (!query_word.is_stop) {
-            if (query_word.is_minus) {
-                result.minus_words.push_back(query_word.data);
+    std::vector<std::string_view> words;
+    ParseQueryWords(text, words, result);
+
+    // sort -> unique -> erase is in MatchDocument for this version ParseQuery
+
+    return result;
+}
+
+bool SearchServer::Query::HasPositions() const {
+    return !phrases.empty() || !proximities.empty();
+}
+
+bool SearchServer::Query::HasOperators() const {
+    return !required_words.empty() || HasPositions();
+}
+
+bool SearchServer::MakePhraseTerms(const Query& query, std::vector<PhraseTerm>& terms, std::vector<size_t>& phrase_ends) const {
+    terms.clear();
+    phrase_ends.clear();
+    for (const Phrase& phrase : query.phrases) {
+        const size_t first = terms.size();
+        for (size_t i = 0; i < phrase.words.size(); ++i) {
+            const int term_id = index_.FindTerm(phrase.words[i]);
+            if (term_id == InvertedIndex::NO_TERM || index_.GetDocumentFreq(term_id) == 0) {
+                return false;
             }
-            else {
-                result.plus_words.push_back(query_word.data);
+            terms.push_back({ term_id, phrase.offsets[i] });
+        }
+        // positions of the rarest word are checked against the rest
+        const auto rarest = std::min_element(terms.begin() + first, terms.end(),
+            [this](const PhraseTerm& lhs, const PhraseTerm& rhs) { return index_.GetDocumentFreq(lhs.term_id) < index_.GetDocumentFreq(rhs.term_id); });
+        std::iter_swap(terms.begin() + first, rarest);
+        phrase_ends.push_back(terms.size());
+    }
+    return true;
+}
+
+void SearchServer::MakeProximityTerms(const Query& query, const std::vector<TermCursor>& cursors, std::vector<ProximityTerms>& terms) const {
+    terms.clear();
+    for (const Proximity& proximity : query.proximities) {
+        const auto find_cursor = [this, &cursors](std::string_view word) {
+            const int term_id = index_.FindTerm(word);
+            return static_cast<size_t>(std::find_if(cursors.begin(), cursors.end(),
+                [term_id](const TermCursor& cursor) { return cursor.term_id == term_id; }) - cursors.begin());
+        };
+        const size_t lhs = find_cursor(proximity.lhs);
+        const size_t rhs = find_cursor(proximity.rhs);
+        if (lhs < cursors.size() && rhs < cursors.size()) {
+            terms.push_back({ lhs, rhs, proximity.distance });
+        }
+    }
+}
+
+void SearchServer::MakeExcludedOrdinals(const std::vector<std::string_view>& minus_words, OrdinalSet& excluded) const {
+    if (minus_words.empty()) {
+        excluded.Clear();
+        return;
+    }
+    excluded.Reset(ordinal_to_document_id_.size());
+    for (const std::string_view word : minus_words) {
+        const int term_id = index_.FindTerm(word);
+        if (term_id == InvertedIndex::NO_TERM) {
+            continue;
+        }
+        for (auto postings = index_.GetPostings(term_id); !postings.IsEnd(); postings.Next()) {
+            excluded.Insert(postings.GetOrdinal());
+        }
+    }
+}
+
+bool SearchServer::IsMaxScoreQuery(const Query& query) const {
+    if (retrieval_mode_ != RetrievalMode::AUTO) {
+        return retrieval_mode_ == RetrievalMode::MAX_SCORE;
+    }
+    size_t term_count = 0;
+    size_t posting_count = 0;
+    for (const std::string_view word : query.plus_words) {
+        const int term_id = index_.FindTerm(word);
+        if (term_id != InvertedIndex::NO_TERM && index_.GetDocumentFreq(term_id) > 0) {
+            ++term_count;
+            posting_count += index_.GetDocumentFreq(term_id);
+        }
+    }
+    return term_count <= MAX_SCORE_MAX_TERM_COUNT && posting_count >= MAX_SCORE_MIN_POSTING_COUNT;
+}
+
+bool SearchServer::HasRequiredWords(const Query& query, int ordinal) const {
+    const std::map<std::string_view, double>& word_freq = *document_to_word_freqs_[ordinal];
+    if (!std::all_of(query.required_words.begin(), query.required_words.end(), [&word_freq](std::string_view word) { return word_freq.count(word); })) {
+        return false;
+    }
+    if (query.phrases.empty()) {
+        return true;
+    }
+    std::vector<PhraseTerm> terms;
+    std::vector<size_t> phrase_ends;
+    if (!MakePhraseTerms(query, terms, phrase_ends)) {
+        return false;
+    }
+    std::vector<std::vector<uint32_t>> positions;
+    for (size_t i = 0; i < phrase_ends.size(); ++i) {
+        if (!FindPhrase(ordinal, terms.data() + (i > 0 ? phrase_ends[i - 1] : 0), terms.data() + phrase_ends[i], positions)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SearchServer::FindPhrase(int ordinal, const PhraseTerm* first, const PhraseTerm* last,
+    std::vector<std::vector<uint32_t>>& positions, std::vector<uint32_t>* starts) const {
+    const size_t term_count = last - first;
+    if (positions.size() < term_count) {
+        positions.resize(term_count);
+    }
+    for (size_t i = 0; i < term_count; ++i) {
+        if (!positions_.GetPositions(ordinal, first[i].term_id, positions[i])) {
+            return false;
+        }
+    }
+
+    // every position of the rarest word is a possible start, the other words are looked up at their offsets
+    for (const uint32_t position : positions[0]) {
+        if (position < first->offset) {
+            continue;
+        }
+        const uint32_t start = position - first->offset;
+        bool is_found = true;
+        for (size_t i = 1; i < term_count && is_found; ++i) {
+            is_found = std::binary_search(positions[i].begin(), positions[i].end(), start + first[i].offset);
+        }
+        if (is_found) {
+            if (!starts) {
+                return true;
             }
+            starts->push_back(start);
         }
     }
+    return starts && !starts->empty();
+}
 
-    // sort -> unique -> erase is in MatchDocument for this version ParseQuery
+bool SearchServer::AreNear(int ordinal, int lhs_term_id, int rhs_term_id, uint32_t distance, std::vector<std::vector<uint32_t>>& positions) const {
+    if (positions.size() < 2) {
+        positions.resize(2);
+    }
+    std::vector<uint32_t>& lhs = positions[0];
+    std::vector<uint32_t>& rhs = positions[1];
+    if (!positions_.GetPositions(ordinal, lhs_term_id, lhs)) {
+        return false;
+    }
+    // the same word is near itself if two of its occurrences are
+    if (lhs_term_id == rhs_term_id) {
+        return std::adjacent_find(lhs.begin(), lhs.end(), [distance](uint32_t a, uint32_t b) { return b - a <= distance; }) != lhs.end();
+    }
+    if (!positions_.GetPositions(ordinal, rhs_term_id, rhs)) {
+        return false;
+    }
+    // both lists are sorted, the closest pair is among neighbours of their merge
+    for (size_t i = 0, j = 0; i < lhs.size() && j < rhs.size();) {
+        if ((lhs[i] < rhs[j] ? rhs[j] - lhs[i] : lhs[i] - rhs[j]) <= distance) {
+            return true;
+        }
+        if (lhs[i] < rhs[j]) {
+            ++i;
+        }
+        else {
+            ++j;
+        }
+    }
+    return false;
+}
 
-    return result;
+
+bool SearchServer::StatusPredicate::operator()([[maybe_unused]] int document_id, DocumentStatus document_status, [[maybe_unused]] int rating) const {
+    return document_status == status;
 }
 
+SearchServer::QueryContext& SearchServer::GetThreadQueryContext() {
+    thread_local QueryContext context;
+    return context;
+}
+
+void SearchServer::SelectTopDocuments(std::vector<Document>& documents, size_t result_count, size_t offset) {
+    if (offset >= documents.size()) {
+        documents.clear();
+        return;
+    }
+    const size_t selected_count = std::min(documents.size(), offset + std::min(result_count, documents.size() - offset));
+    // O(n) selection of the top, only the selected part is sorted
+    if (selected_count < documents.size()) {
+        std::nth_element(documents.begin(), documents.begin() + selected_count, documents.end(), IsMoreRelevant);
+    }
+    documents.resize(selected_count);
+    std::sort(documents.begin(), documents.end(), IsMoreRelevant);
+    documents.erase(documents.begin(), documents.begin() + offset);
+}
+
+bool SearchServer::TermCursor::SeekBlock(int ordinal) {
+    return postings.SeekBlock(ordinal);
+}
+
+bool SearchServer::TermCursor::Seek(int ordinal) {
+    return postings.Seek(ordinal);
+}
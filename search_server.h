@@ -1,44 +1,152 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cmath>
+#include <cstdint>
 #include <execution>
+#include <limits>
 #include <map>
+#include <memory>
+#include <numeric>
 #include <set>
 #include <stdexcept>
 #include <string>
 #include <string_view>
 #include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
-#include "concurrent_map.h"
 #include "document.h"
+#include "inverted_index.h"
 #include "log_duration.h"
+#include "ordinal_set.h"
+#include "position_index.h"
+#include "ranking.h"
+#include "snapshot.h"
 #include "string_processing.h"
+#include "term_dictionary.h"
+#include "thread_pool.h"
 
 constexpr int MAX_RESULT_DOCUMENT_COUNT = 5;
 constexpr double MIN_REAL_VALUE = 1e-6;
+// parallel search doesn't split ordinals into smaller ranges
+constexpr int MIN_SHARD_SIZE = 1024;
+// AddDocuments doesn't split documents into smaller chunks
+constexpr int MIN_INGEST_CHUNK_SIZE = 256;
+// scores of words of "lhs NEAR/k rhs" are added once more if they are within k words of each other
+constexpr double PROXIMITY_BOOST = 1.0;
+// AUTO retrieval: MaxScore takes every candidate from the least ordinal of essential words,
+// so for queries of more words exhaustive scan is faster
+constexpr size_t MAX_SCORE_MAX_TERM_COUNT = 16;
+// AUTO retrieval: lists of a few blocks in total are scanned faster than skipped
+constexpr size_t MAX_SCORE_MIN_POSTING_COUNT = 4 * InvertedIndex::BLOCK_SIZE;
+
+// how FindTopDocuments collects results:
+// EXHAUSTIVE scores every matched document and sorts them all,
+// MAX_SCORE skips documents whose upper bound can't reach current top,
+// AUTO takes MaxScore for queries of a few words with long lists and exhaustive scan for others
+enum class RetrievalMode {
+    EXHAUSTIVE,
+    MAX_SCORE,
+    AUTO,
+};
+
+// occurrences of quoted phrase of query in document
+struct PhraseMatch {
+    // words of phrase without stop words
+    std::vector<std::string_view> words;
+    // sorted positions of the first word of phrase (stop words are counted), one per occurrence
+    std::vector<uint32_t> positions;
+};
+
+// document for bulk SearchServer::AddDocuments, text is not kept after adding
+struct DocumentToAdd {
+    int id;
+    std::string_view text;
+    DocumentStatus status;
+    std::vector<int> ratings;
+};
 
 class SearchServer {
 public:
+    // buffers of query execution which are reused by the next queries, so steady sequential search
+    // doesn't allocate memory. One context is used by one thread at a time
+    class QueryContext;
+
     template <typename StringContainer>
     explicit SearchServer(const StringContainer& stop_words);
     explicit SearchServer(const std::string_view stop_words_text);
     explicit SearchServer(const std::string& stop_words_text);
+    // words, word frequencies and positions of documents and sealed segments are shared with other,
+    // they are never changed in place. Per-document arrays and id maps are copied
+    SearchServer(const SearchServer& other) = default;
+    SearchServer(SearchServer&& other) = default;
 
     void AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    // tokenizes documents in parallel and appends them to the index in one pass,
+    // all of them are checked first, so nothing is added if any one is invalid
+    void AddDocuments(const std::vector<DocumentToAdd>& documents);
+
+    // versioned binary snapshot of stop words, documents and segments of index as they are in memory,
+    // removed documents stay tombstones, so ordinals don't change
+    void SaveSnapshot(const std::string& path) const;
+    // snapshot file is mapped, posting lists are checked and used in place, not copied. Word frequencies
+    // are restored from saved words of documents and positions from posting lists, documents are not tokenized again
+    static SearchServer LoadSnapshot(const std::string& path);
 
     // added execution policy
-    template <typename Predicate>
+    // Ranking (see ranking.h) is given explicitly: FindTopDocuments<Bm25>(std::execution::par, raw_query)
+    // +word of query is required: only documents with all required words are scored, lists of them are intersected
+    template <typename Ranking = TfIdf, typename Predicate>
     std::vector<Document> FindTopDocuments(const std::string_view raw_query, Predicate document_predicate) const;
+    template <typename Ranking = TfIdf>
     std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status) const;
+    template <typename Ranking = TfIdf>
     std::vector<Document> FindTopDocuments(const std::string_view raw_query) const;
-    template <typename ExecutionPolicy, typename Predicate>
+    template <typename Ranking = TfIdf, typename ExecutionPolicy, typename Predicate>
     std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, const std::string_view raw_query, Predicate document_predicate) const;
-    template <typename ExecutionPolicy>
+    template <typename Ranking = TfIdf, typename ExecutionPolicy>
     std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, const std::string_view raw_query, DocumentStatus status) const;
-    template <typename ExecutionPolicy>
+    template <typename Ranking = TfIdf, typename ExecutionPolicy>
     std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, const std::string_view raw_query) const;
+    // page of result_count documents starting from offset-th one in the same order
+    template <typename Ranking = TfIdf, typename ExecutionPolicy, typename Predicate>
+    std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, const std::string_view raw_query, Predicate document_predicate, size_t result_count, size_t offset = 0) const;
+    template <typename Ranking = TfIdf, typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, const std::string_view raw_query, DocumentStatus status, size_t result_count, size_t offset = 0) const;
+    // sequential search in buffers of context, result is valid until the next search with it
+    template <typename Ranking = TfIdf, typename Predicate>
+    const std::vector<Document>& FindTopDocuments(QueryContext& context, const std::string_view raw_query, Predicate document_predicate,
+        size_t result_count = MAX_RESULT_DOCUMENT_COUNT, size_t offset = 0) const;
+    template <typename Ranking = TfIdf>
+    const std::vector<Document>& FindTopDocuments(QueryContext& context, const std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL,
+        size_t result_count = MAX_RESULT_DOCUMENT_COUNT, size_t offset = 0) const;
+
+    // canonical form of query: sorted unique plus words, then minus words with '-', required ones with '+',
+    // phrases and NEAR pairs
+    std::string NormalizeQuery(const std::string_view raw_query) const;
+    // changes on every AddDocument/RemoveDocument, results of equal generations are equal
+    uint64_t GetGeneration() const;
+
+    void SetRetrievalMode(RetrievalMode mode);
+    RetrievalMode GetRetrievalMode() const;
+
+    // Positions of words are stored for quoted phrases ("big cat", documents must contain it) and
+    // proximity (cat NEAR/3 dog, documents with the words within 3 positions rank higher).
+    // They are switched on before documents are added, queries with phrases throw without them
+    void SetPositionsEnabled(bool enabled);
+    bool ArePositionsEnabled() const;
+
+    // seals recently added documents into read-only segment and waits for background merges of segments,
+    // results of search don't change
+    void Flush();
+    size_t GetSegmentCount() const;
+    // bytes of arena blocks of words of documents, they are shared by copies of server
+    size_t GetWordArenaSize() const;
 
     std::set<int>::const_iterator begin() const;
     std::set<int>::const_iterator end() const;
@@ -50,179 +158,824 @@ public:
     void RemoveDocument(int document_id);
     void RemoveDocument(const std::execution::sequenced_policy& policy, int document_id);
     void RemoveDocument(const std::execution::parallel_policy& policy, int document_id);
+    // removal of many documents at once: they become tombstones of index,
+    // their postings are dropped by merges of segments
+    void RemoveDocuments(const std::vector<int>& document_ids);
+    void RemoveDocuments(const std::execution::sequenced_policy& policy, const std::vector<int>& document_ids);
+    // the same sequential removal, it is kept for callers with policy: only tombstones and counters change
+    void RemoveDocuments(const std::execution::parallel_policy& policy, const std::vector<int>& document_ids);
 
     // added execution policy
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::string_view raw_query, int document_id) const;
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::execution::sequenced_policy& policy, const std::string_view raw_query, int document_id) const;
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::execution::parallel_policy& policy, const std::string_view raw_query, int document_id) const;
+    // phrases of query found in document, empty if document doesn't match query
+    std::vector<PhraseMatch> MatchPhrases(const std::string_view raw_query, int document_id) const;
 
 
 private:
-    struct DocumentData {
-        int rating;
+    // predicate of FindTopDocuments with status, documents of the status are found by bitset instead of calls
+    struct StatusPredicate {
         DocumentStatus status;
+
+        bool operator()(int document_id, DocumentStatus document_status, int rating) const;
     };
 
     struct QueryWord {
         std::string_view data;
         bool is_minus;
         bool is_stop;
+        bool is_required;
+    };
+
+    // words of quoted phrase are plus words too, stop words are kept as gaps between offsets
+    struct Phrase {
+        std::vector<std::string_view> words;
+        std::vector<uint32_t> offsets;
+    };
+
+    // lhs NEAR/distance rhs, both words are plus words
+    struct Proximity {
+        std::string_view lhs;
+        std::string_view rhs;
+        uint32_t distance;
     };
 
     struct Query {
         std::vector<std::string_view> plus_words;
         std::vector<std::string_view> minus_words;
+        // +word, every document has them, they are plus words too
+        std::vector<std::string_view> required_words;
+        // phrases of at least two words
+        std::vector<Phrase> phrases;
+        std::vector<Proximity> proximities;
+
+        bool HasPositions() const;
+        // required words, phrases or NEAR, such queries are searched by FindRequiredDocuments
+        bool HasOperators() const;
+    };
+
+    // position in posting list of one query word for MaxScore retrieval
+    // weight and max score of the word are computed once per query
+    struct TermCursor {
+        InvertedIndex::PostingIterator postings;
+        TermWeight weight;
+        double max_score;
+        int term_id;
+        // the block whose max score was computed last, cursors don't go back, so every block is scored once
+        const InvertedIndex::ScoreBounds* scored_block = nullptr;
+        double block_max_score = 0.0;
+
+        bool IsEnd() const;
+        int GetOrdinal() const;
+        void Next();
+        // moves to block which may contain ordinal, false if there is no such block
+        bool SeekBlock(int ordinal);
+        // moves to first posting not less than ordinal, true if it is equal
+        bool Seek(int ordinal);
+        // upper bound of scores of the current block, valid after SeekBlock
+        template <typename Ranking>
+        double GetBlockMaxScore(const Ranking& ranking);
+    };
+
+    // word of phrase, words of every phrase go from the rarest one
+    struct PhraseTerm {
+        int term_id;
+        uint32_t offset;
+    };
+
+    // indices of NEAR words in cursors of plus words
+    struct ProximityTerms {
+        size_t lhs;
+        size_t rhs;
+        uint32_t distance;
     };
 
-    // save strings for string_view (std::less<>)
-    const std::set<std::string, std::less<>> stop_words_;
-    std::set<std::string, std::less<>> words_;
+    RetrievalMode retrieval_mode_ = RetrievalMode::AUTO;
+    bool are_positions_enabled_ = false;
+    uint64_t generation_ = 0;
+    // words of documents which are present, for average document length
+    uint64_t total_word_count_ = 0;
 
-    std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
-    std::map<int, std::map<std::string_view, double>> document_to_word_freqs_;
-    std::map<int, DocumentData> documents_;
+    const TermDictionary stop_words_;
+    // words of documents are kept in dictionary of index, views into it are valid while they have documents
+    InvertedIndex index_;
+    PositionIndex positions_;
     std::set<int> document_ids_;
 
+    // documents are stored by dense ordinal, external ids are mapped on it
+    std::unordered_map<int, int> document_id_to_ordinal_;
+    std::vector<int> ordinal_to_document_id_;
+    std::vector<int> document_ratings_;
+    std::vector<DocumentStatus> document_statuses_;
+    // ordinals of present documents by status
+    std::array<OrdinalSet, static_cast<size_t>(DocumentStatus::REMOVED) + 1> status_ordinals_;
+    // shared by copies of server, nullptr for removed documents
+    std::vector<std::shared_ptr<const std::map<std::string_view, double>>> document_to_word_freqs_;
+
+    // returns -1 if there is no such document
+    int FindDocumentOrdinal(int document_id) const;
+    // number of ordinal ranges for parallel search
+    size_t GetShardCount() const;
+    // [first, last) ordinals of shard
+    std::pair<int, int> GetShardRange(size_t shard, size_t shard_count) const;
+
+    // sorted unique ordinals of documents which are present
+    std::vector<int> GetExistingOrdinals(const std::vector<int>& document_ids) const;
+    // term id -> number of removed documents with it, ordinals are unique and present
+    std::vector<std::pair<int, size_t>> GetRemovedTermCounts(const std::vector<int>& ordinals) const;
+    void ReleaseRemovedDocuments(const std::vector<int>& ordinals, const std::vector<std::pair<int, size_t>>& removed_term_counts);
+    // index drops ordinals of removed documents, arrays by ordinal follow it
+    void CompactOrdinals();
+    // bytes of removed words are released, word frequencies get views into new bytes
+    void CompactWords();
+
+    // throws if some of words is invalid
+    static TermDictionary MakeStopWords(const std::set<std::string, std::less<>>& stop_words);
+    // for the snapshot, which keeps words in order
+    static std::vector<std::string_view> GetSortedWords(const TermDictionary& words);
     bool IsStopWord(const std::string_view word) const;
     static bool IsValidWord(const std::string_view word);
-    std::vector<std::string_view> SplitIntoWordsNoStop(const std::string_view text) const;
+    static bool IsValidStatus(DocumentStatus status);
+    // words are written into caller's buffer, throws if some word is invalid
+    void SplitIntoWordsNoStop(const std::string_view text, std::vector<std::string_view>& words) const;
+    // and positions of words in text with stop words
+    void SplitIntoWordsNoStop(const std::string_view text, std::vector<std::string_view>& words, std::vector<uint32_t>& positions) const;
+    // words are sorted, positions of equal words too
+    static void SortWords(std::vector<std::string_view>& words, std::vector<uint32_t>& positions);
     static int ComputeAverageRating(const std::vector<int>& ratings);
-    double ComputeWordInverseDocumentFreq(const std::string_view word) const;
+    TermStatistics GetTermStatistics(int term_id) const;
 
     // Queries Function
+    static void SplitIntoQueryWords(const std::string_view text, std::vector<std::string_view>& words);
+    // characters of text are checked by SplitIntoQueryWords
     QueryWord ParseQueryWord(const std::string_view text) const;
+    // NEAR/distance, false if word is not an operator, throws if distance is invalid
+    static bool ParseProximityOperator(const std::string_view word, uint32_t& distance);
+    // plus and minus words of query in order, they may repeat
+    void ParseQueryWords(const std::string_view text, std::vector<std::string_view>& words, Query& result) const;
     Query ParseQuery(const std::execution::sequenced_policy& policy, const std::string_view text) const;
+    // same as sequenced one, but words and query keep their capacity
+    void ParseQuery(const std::string_view text, std::vector<std::string_view>& words, Query& result) const;
     Query ParseQuery(const std::execution::parallel_policy& policy, const std::string_view text) const;
 
+    static bool IsMoreRelevant(const Document& lhs, const Document& rhs);
+    // keeps only [offset, offset + result_count) of documents ordered by IsMoreRelevant
+    static void SelectTopDocuments(std::vector<Document>& documents, size_t result_count, size_t offset);
+
+    // context of the calling thread for sequential search
+    static QueryContext& GetThreadQueryContext();
+
+    // cursors of words which are present in some documents
+    template <typename Ranking>
+    void MakeTermCursors(const std::vector<std::string_view>& words, std::vector<TermCursor>& cursors) const;
+    // terms of phrases of query, false if some word of them is in no document
+    bool MakePhraseTerms(const Query& query, std::vector<PhraseTerm>& terms, std::vector<size_t>& phrase_ends) const;
+    // NEAR pairs by indices of cursors, pairs with a word absent from all documents are dropped
+    void MakeProximityTerms(const Query& query, const std::vector<TermCursor>& cursors, std::vector<ProximityTerms>& terms) const;
+    // cursors, required terms, terms of phrases and NEAR pairs of query in context, false if no document can match
+    template <typename Ranking>
+    bool MakeRequiredCursors(const Query& query, QueryContext& context) const;
+    // document has every required word and phrase of query
+    bool HasRequiredWords(const Query& query, int ordinal) const;
+    // query goes to MaxScore by retrieval mode, AUTO counts its words and postings
+    bool IsMaxScoreQuery(const Query& query) const;
+    // documents of status of StatusPredicate, nullptr for other predicates.
+    // Documents out of the set are skipped before scoring, so the predicate isn't called for status queries
     template <typename Predicate>
-    std::vector<Document> FindAllDocuments(const std::execution::sequenced_policy& policy, const Query& query, Predicate document_predicate) const;
-    template <typename Predicate>
+    const OrdinalSet* GetStatusOrdinals(const Predicate& document_predicate) const;
+    // documents of minus words, the set is left empty without them
+    void MakeExcludedOrdinals(const std::vector<std::string_view>& minus_words, OrdinalSet& excluded) const;
+    // the first positions of phrase in document (all of them if starts is given), false if it has no phrase
+    bool FindPhrase(int ordinal, const PhraseTerm* first, const PhraseTerm* last,
+        std::vector<std::vector<uint32_t>>& positions, std::vector<uint32_t>* starts = nullptr) const;
+    // some positions of the words are within distance
+    bool AreNear(int ordinal, int lhs_term_id, int rhs_term_id, uint32_t distance, std::vector<std::vector<uint32_t>>& positions) const;
+
+    // every shard of ordinals collects its own top, then they are merged
+    template <typename Ranking, typename Predicate>
+    std::vector<Document> FindTopDocumentsMaxScore(const std::execution::parallel_policy& policy, const Query& query, Predicate document_predicate, size_t result_count) const;
+    // top among ordinals [first_ordinal, last_ordinal) by cursors of context into its documents,
+    // shared_threshold (if any) is exchanged with other shards searching the same query
+    template <typename Ranking, typename Predicate>
+    void FindTopDocumentsMaxScore(QueryContext& context, Predicate document_predicate, size_t result_count, int first_ordinal, int last_ordinal,
+        std::atomic<double>* shared_threshold = nullptr) const;
+
+    // matched documents of query of context into its documents
+    template <typename Ranking, typename Predicate>
+    void FindAllDocuments(QueryContext& context, Predicate document_predicate) const;
+    // query with required words, phrases or NEAR: ordinals [first_ordinal, last_ordinal) having all required words
+    // and words of phrases are found by intersection of their lists from the rarest word, minus words and positions
+    // of phrases are checked before scoring. Without them every document of plus words is a candidate.
+    // All matched documents go to context
+    template <typename Ranking, typename Predicate>
+    void FindRequiredDocuments(QueryContext& context, Predicate document_predicate, int first_ordinal, int last_ordinal) const;
+    template <typename Ranking, typename Predicate>
+    std::vector<Document> FindRequiredDocuments(const std::execution::parallel_policy& policy, const Query& query, Predicate document_predicate) const;
+    template <typename Ranking, typename Predicate>
     std::vector<Document> FindAllDocuments(const std::execution::parallel_policy& policy, const Query& query, Predicate document_predicate) const;
 };
 
+class SearchServer::QueryContext {
+private:
+    friend class SearchServer;
+
+    std::vector<std::string_view> words_;
+    Query query_;
+    std::vector<TermCursor> cursors_;
+    std::vector<TermCursor> minus_cursors_;
+    std::vector<double> max_score_prefix_;
+    // exhaustive search accumulates relevance by ordinal, only matched entries are reset
+    std::vector<double> relevances_;
+    std::vector<char> is_matched_;
+    std::vector<int> matched_ordinals_;
+    OrdinalSet excluded_ordinals_;
+    std::vector<Document> documents_;
+    // queries with positions
+    std::vector<PhraseTerm> phrase_terms_;
+    std::vector<size_t> phrase_ends_;
+    std::vector<int> required_term_ids_;
+    std::vector<InvertedIndex::PostingIterator> required_postings_;
+    std::vector<ProximityTerms> proximity_terms_;
+    std::vector<double> scores_;
+    std::vector<std::vector<uint32_t>> term_positions_;
+};
+
 //
 template <typename StringContainer>
 SearchServer::SearchServer(const StringContainer& stop_words)
-    : stop_words_(MakeUniqueNonEmptyStrings(stop_words))
+    : stop_words_(MakeStopWords(MakeUniqueNonEmptyStrings(stop_words)))
 {
-    if (!all_of(stop_words_.begin(), stop_words_.end(), IsValidWord)) {
-        throw std::invalid_argument("Some of stop words are invalid");
-    }
 }//*/
 
 //
-template <typename Predicate>
+template <typename Ranking, typename Predicate>
 std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query, Predicate document_predicate) const {
-    return FindTopDocuments(std::execution::seq, raw_query, document_predicate);
+    return FindTopDocuments<Ranking>(std::execution::seq, raw_query, document_predicate);
+}
+
+template <typename Ranking>
+std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query, DocumentStatus status) const {
+    return FindTopDocuments<Ranking>(std::execution::seq, raw_query, status);
+}
+
+template <typename Ranking>
+std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query) const {
+    return FindTopDocuments<Ranking>(std::execution::seq, raw_query);
 }
 
 //
-template <typename ExecutionPolicy, typename Predicate>
+template <typename Ranking, typename ExecutionPolicy, typename Predicate>
 std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, const std::string_view raw_query, Predicate document_predicate) const {
+    return FindTopDocuments<Ranking>(policy, raw_query, document_predicate, MAX_RESULT_DOCUMENT_COUNT);
+}
 
-    const auto query = ParseQuery(std::execution::seq, raw_query);
-    
-    auto matched_documents = FindAllDocuments(policy, query, document_predicate);
+template <typename Ranking, typename ExecutionPolicy, typename Predicate>
+std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, const std::string_view raw_query, Predicate document_predicate, size_t result_count, size_t offset) const {
+    if constexpr (std::is_same_v<ExecutionPolicy, std::execution::sequenced_policy>) {
+        return FindTopDocuments<Ranking>(GetThreadQueryContext(), raw_query, document_predicate, result_count, offset);
+    }
+    else {
+        const auto query = ParseQuery(std::execution::seq, raw_query);
 
-    std::sort(//std::execution::par,
-        matched_documents.begin(), matched_documents.end(),
-        [](const Document& lhs, const Document& rhs) {
-            if (std::abs(lhs.relevance - rhs.relevance) < MIN_REAL_VALUE) {
-                return lhs.rating > rhs.rating;
-            }
-            else {
-                return lhs.relevance > rhs.relevance;
-            }
-        });
+        if (query.HasOperators()) {
+            auto matched_documents = FindRequiredDocuments<Ranking>(policy, query, document_predicate);
+            SelectTopDocuments(matched_documents, result_count, offset);
+            return matched_documents;
+        }
+
+        if (IsMaxScoreQuery(query)) {
+            auto top_documents = FindTopDocumentsMaxScore<Ranking>(policy, query, document_predicate,
+                result_count > std::numeric_limits<size_t>::max() - offset ? std::numeric_limits<size_t>::max() : offset + result_count);
+            top_documents.erase(top_documents.begin(), top_documents.begin() + std::min(offset, top_documents.size()));
+            return top_documents;
+        }
+
+        auto matched_documents = FindAllDocuments<Ranking>(policy, query, document_predicate);
+        SelectTopDocuments(matched_documents, result_count, offset);
 
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+        return matched_documents;
     }
+}
 
-    return matched_documents;
+template <typename Ranking, typename Predicate>
+const std::vector<Document>& SearchServer::FindTopDocuments(QueryContext& context, const std::string_view raw_query, Predicate document_predicate, size_t result_count, size_t offset) const {
+    ParseQuery(raw_query, context.words_, context.query_);
+
+    if (context.query_.HasOperators()) {
+        context.documents_.clear();
+        if (MakeRequiredCursors<Ranking>(context.query_, context)) {
+            FindRequiredDocuments<Ranking>(context, document_predicate, 0, static_cast<int>(ordinal_to_document_id_.size()));
+        }
+        SelectTopDocuments(context.documents_, result_count, offset);
+        return context.documents_;
+    }
+
+    if (IsMaxScoreQuery(context.query_)) {
+        MakeTermCursors<Ranking>(context.query_.plus_words, context.cursors_);
+        MakeTermCursors<Ranking>(context.query_.minus_words, context.minus_cursors_);
+        FindTopDocumentsMaxScore<Ranking>(context, document_predicate,
+            result_count > std::numeric_limits<size_t>::max() - offset ? std::numeric_limits<size_t>::max() : offset + result_count,
+            0, static_cast<int>(ordinal_to_document_id_.size()));
+        context.documents_.erase(context.documents_.begin(), context.documents_.begin() + std::min(offset, context.documents_.size()));
+        return context.documents_;
+    }
+
+    FindAllDocuments<Ranking>(context, document_predicate);
+    SelectTopDocuments(context.documents_, result_count, offset);
+    return context.documents_;
 }
 
-template <typename ExecutionPolicy>
+template <typename Ranking>
+const std::vector<Document>& SearchServer::FindTopDocuments(QueryContext& context, const std::string_view raw_query, DocumentStatus status, size_t result_count, size_t offset) const {
+    return FindTopDocuments<Ranking>(context, raw_query, StatusPredicate{ status }, result_count, offset);
+}
+
+template <typename Ranking, typename ExecutionPolicy>
 std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, const std::string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(policy, raw_query, [status]([[maybe_unused]] int document_id, DocumentStatus document_status, [[maybe_unused]] int rating) {
-        return document_status == status;
-        });
+    return FindTopDocuments<Ranking>(policy, raw_query, StatusPredicate{ status });
 }
 
-template <typename ExecutionPolicy>
+template <typename Ranking, typename ExecutionPolicy>
 std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, const std::string_view raw_query) const {
-    return FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL);
+    return FindTopDocuments<Ranking>(policy, raw_query, DocumentStatus::ACTUAL);
 }
 
-template <typename Predicate>
-std::vector<Document> SearchServer::FindAllDocuments(const std::execution::sequenced_policy& policy, const Query& query, Predicate document_predicate) const {
-    std::map<int, double> document_to_relevance;
-    for (const std::string_view word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
+template <typename Ranking, typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, const std::string_view raw_query, DocumentStatus status, size_t result_count, size_t offset) const {
+    return FindTopDocuments<Ranking>(policy, raw_query, StatusPredicate{ status }, result_count, offset);
+}
+
+// called for every posting of MaxScore, so they are inline
+
+inline bool SearchServer::TermCursor::IsEnd() const {
+    return postings.IsEnd();
+}
+
+inline int SearchServer::TermCursor::GetOrdinal() const {
+    return postings.GetOrdinal();
+}
+
+inline void SearchServer::TermCursor::Next() {
+    postings.Next();
+}
+
+template <typename Ranking>
+double SearchServer::TermCursor::GetBlockMaxScore(const Ranking& ranking) {
+    const InvertedIndex::ScoreBounds& bounds = postings.GetBlockBounds();
+    if (scored_block != &bounds) {
+        scored_block = &bounds;
+        block_max_score = ranking.GetMaxScore(weight, bounds);
+    }
+    return block_max_score;
+}
+
+inline bool SearchServer::IsMoreRelevant(const Document& lhs, const Document& rhs) {
+    if (std::abs(lhs.relevance - rhs.relevance) < MIN_REAL_VALUE) {
+        if (lhs.rating == rhs.rating) {
+            return lhs.id < rhs.id;
+        }
+        return lhs.rating > rhs.rating;
+    }
+    else {
+        return lhs.relevance > rhs.relevance;
+    }
+}
+
+// MaxScore with block-max bounds: query words are ordered by their maximal contribution,
+// the cheapest ones whose total can't lift a document into current top are "non-essential".
+// Candidates are taken only from essential words, non-essential ones are probed
+// while the upper bound of the candidate still reaches the threshold.
+template <typename Ranking, typename Predicate>
+std::vector<Document> SearchServer::FindTopDocumentsMaxScore(const std::execution::parallel_policy& policy, const Query& query, Predicate document_predicate, size_t result_count) const {
+    std::vector<TermCursor> cursors;
+    std::vector<TermCursor> minus_cursors;
+    MakeTermCursors<Ranking>(query.plus_words, cursors);
+    MakeTermCursors<Ranking>(query.minus_words, minus_cursors);
+
+    const size_t shard_count = GetShardCount();
+    std::vector<std::vector<Document>> shard_documents(shard_count);
+    // k-th document of any shard bounds the k-th one of the whole result
+    std::atomic<double> shared_threshold = -std::numeric_limits<double>::infinity();
+
+    ThreadPool::GetDefault().ParallelFor(0, shard_count,
+        [&](size_t shard) {
+            const auto [first, last] = GetShardRange(shard, shard_count);
+            QueryContext context;
+            context.cursors_ = cursors;
+            context.minus_cursors_ = minus_cursors;
+            FindTopDocumentsMaxScore<Ranking>(context, document_predicate, result_count, first, last, &shared_threshold);
+            shard_documents[shard] = std::move(context.documents_);
+        });
+
+    std::vector<Document> top_documents;
+    for (const auto& documents : shard_documents) {
+        top_documents.insert(top_documents.end(), documents.begin(), documents.end());
+    }
+    SelectTopDocuments(top_documents, result_count, 0);
+    return top_documents;
+}
+
+template <typename Ranking, typename Predicate>
+void SearchServer::FindTopDocumentsMaxScore(QueryContext& context, Predicate document_predicate, size_t result_count, int first_ordinal, int last_ordinal,
+    std::atomic<double>* shared_threshold) const {
+    const Ranking ranking{};
+    std::vector<TermCursor>& cursors = context.cursors_;
+    std::vector<TermCursor>& minus_cursors = context.minus_cursors_;
+    std::vector<Document>& top_documents = context.documents_;
+    top_documents.clear();
+    if (result_count == 0) {
+        return;
+    }
+    top_documents.reserve(std::min(result_count, static_cast<size_t>(last_ordinal - first_ordinal)) + 1);
+
+    if (first_ordinal > 0) {
+        for (TermCursor& cursor : cursors) {
+            cursor.Seek(first_ordinal);
+        }
+        for (TermCursor& cursor : minus_cursors) {
+            cursor.Seek(first_ordinal);
+        }
+    }
+
+    std::sort(cursors.begin(), cursors.end(),
+        [](const TermCursor& lhs, const TermCursor& rhs) { return lhs.max_score < rhs.max_score; });
+    std::vector<double>& max_score_prefix = context.max_score_prefix_;
+    max_score_prefix.resize(cursors.size());
+    double max_score_sum = 0.0;
+    for (size_t i = 0; i < cursors.size(); ++i) {
+        max_score_sum += cursors[i].max_score;
+        max_score_prefix[i] = max_score_sum;
+    }
+
+    // documents within MIN_REAL_VALUE of the worst one may still win by rating
+    double threshold = -std::numeric_limits<double>::infinity();
+    size_t first_essential = 0;
+    auto raise_threshold = [&](double value) {
+        if (value <= threshold) {
+            return;
+        }
+        threshold = value;
+        while (first_essential < cursors.size() && max_score_prefix[first_essential] < threshold) {
+            ++first_essential;
+        }
+    };
+
+    while (true) {
+        if (shared_threshold) {
+            raise_threshold(shared_threshold->load(std::memory_order_relaxed));
+        }
+
+        int ordinal = std::numeric_limits<int>::max();
+        for (size_t i = first_essential; i < cursors.size(); ++i) {
+            if (!cursors[i].IsEnd()) {
+                ordinal = std::min(ordinal, cursors[i].GetOrdinal());
+            }
+        }
+        if (ordinal >= last_ordinal) {
+            break;
+        }
+
+        double relevance = 0.0;
+        for (size_t i = first_essential; i < cursors.size(); ++i) {
+            TermCursor& cursor = cursors[i];
+            if (!cursor.IsEnd() && cursor.GetOrdinal() == ordinal) {
+                relevance += ranking.GetScore(cursor.weight, cursor.postings);
+                cursor.Next();
+            }
+        }
+
+        const int document_id = ordinal_to_document_id_[ordinal];
+        if (!document_predicate(document_id, document_statuses_[ordinal], document_ratings_[ordinal])) {
             continue;
         }
 
-        const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
+        double bound = relevance + (first_essential > 0 ? max_score_prefix[first_essential - 1] : 0.0);
+        for (size_t i = first_essential; i-- > 0 && bound >= threshold;) {
+            TermCursor& cursor = cursors[i];
+            bound -= cursor.max_score;
+            if (!cursor.SeekBlock(ordinal) || bound + cursor.GetBlockMaxScore(ranking) < threshold) {
+                continue;
+            }
+            if (cursor.Seek(ordinal)) {
+                const double score = ranking.GetScore(cursor.weight, cursor.postings);
+                relevance += score;
+                bound += score;
+            }
+        }
+        if (bound < threshold) {
+            continue;
+        }
 
-        for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-            const auto& document_data = documents_.at(document_id);
-            if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                document_to_relevance[document_id] += term_freq * inverse_document_freq;
+        if (std::any_of(minus_cursors.begin(), minus_cursors.end(),
+            [ordinal](TermCursor& cursor) { return cursor.Seek(ordinal); })) {
+            continue;
+        }
+
+        top_documents.push_back({ document_id, relevance, document_ratings_[ordinal] });
+        std::push_heap(top_documents.begin(), top_documents.end(), IsMoreRelevant);
+        if (top_documents.size() > result_count) {
+            std::pop_heap(top_documents.begin(), top_documents.end(), IsMoreRelevant);
+            top_documents.pop_back();
+        }
+        if (top_documents.size() == result_count) {
+            raise_threshold(top_documents.front().relevance - 2 * MIN_REAL_VALUE);
+            if (shared_threshold) {
+                double shared = shared_threshold->load(std::memory_order_relaxed);
+                while (shared < threshold && !shared_threshold->compare_exchange_weak(shared, threshold, std::memory_order_relaxed)) {
+                }
             }
         }
     }
 
-    for (const std::string_view word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
+    std::sort_heap(top_documents.begin(), top_documents.end(), IsMoreRelevant);
+}
+
+// relevance is accumulated in dense buffers of context like in parallel version
+template <typename Ranking, typename Predicate>
+void SearchServer::FindAllDocuments(QueryContext& context, Predicate document_predicate) const {
+    const Ranking ranking{};
+    std::vector<double>& relevances = context.relevances_;
+    std::vector<char>& is_matched = context.is_matched_;
+    std::vector<int>& matched_ordinals = context.matched_ordinals_;
+    if (relevances.size() < ordinal_to_document_id_.size()) {
+        relevances.resize(ordinal_to_document_id_.size(), 0.0);
+        is_matched.resize(ordinal_to_document_id_.size(), false);
+    }
+    matched_ordinals.clear();
+    const OrdinalSet* const status_ordinals = GetStatusOrdinals(document_predicate);
+    OrdinalSet& excluded = context.excluded_ordinals_;
+    MakeExcludedOrdinals(context.query_.minus_words, excluded);
+
+    for (const std::string_view word : context.query_.plus_words) {
+        const int term_id = index_.FindTerm(word);
+        if (term_id == InvertedIndex::NO_TERM) {
             continue;
         }
 
-        for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-            document_to_relevance.erase(document_id);
+        const TermWeight weight = ranking.GetTermWeight(GetTermStatistics(term_id));
+
+        for (auto postings = index_.GetPostings(term_id); !postings.IsEnd(); postings.Next()) {
+            const int ordinal = postings.GetOrdinal();
+            if ((status_ordinals ? !status_ordinals->Contains(ordinal)
+                    : !document_predicate(ordinal_to_document_id_[ordinal], document_statuses_[ordinal], document_ratings_[ordinal])) ||
+                excluded.Contains(ordinal)) {
+                continue;
+            }
+            if (!is_matched[ordinal]) {
+                is_matched[ordinal] = true;
+                matched_ordinals.push_back(ordinal);
+            }
+            relevances[ordinal] += ranking.GetScore(weight, postings);
         }
     }
 
-    std::vector<Document> matched_documents;
-    for (const auto [document_id, relevance] : document_to_relevance) {
-        matched_documents.push_back({ document_id, relevance, documents_.at(document_id).rating });
+    // documents go in order of ordinals, as they did from std::map
+    std::sort(matched_ordinals.begin(), matched_ordinals.end());
+    std::vector<Document>& matched_documents = context.documents_;
+    matched_documents.clear();
+    for (const int ordinal : matched_ordinals) {
+        matched_documents.push_back({ ordinal_to_document_id_[ordinal], relevances[ordinal], document_ratings_[ordinal] });
+        relevances[ordinal] = 0.0;
+        is_matched[ordinal] = false;
     }
-
-    return matched_documents;
 }
 
-template <typename Predicate>
+// ordinals are split into ranges processed independently: every shard accumulates relevance
+// in its own dense thread-local buffer, so there are no locks and no shared maps
+template <typename Ranking, typename Predicate>
 std::vector<Document> SearchServer::FindAllDocuments(const std::execution::parallel_policy& policy, const Query& query, Predicate document_predicate) const {
-    ConcurrentMap<int, double> document_to_relevance(101);
-    for_each(std::execution::par,
-        query.plus_words.begin(), query.plus_words.end(),
-        [this, &document_to_relevance, &document_predicate] (const auto& word) {
-            if (word_to_document_freqs_.count(word)) {
-                const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-
-                for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-                    const auto& document_data = documents_.at(document_id);
-                    if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                        document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
+    const Ranking ranking{};
+    std::vector<std::pair<int, TermWeight>> plus_terms;
+    for (const std::string_view word : query.plus_words) {
+        const int term_id = index_.FindTerm(word);
+        if (term_id != InvertedIndex::NO_TERM) {
+            plus_terms.push_back({ term_id, ranking.GetTermWeight(GetTermStatistics(term_id)) });
+        }
+    }
+    // one set of excluded documents is read by all shards. It is taken out of the context of the calling thread
+    // and put back at the end, since this thread may run other queries while it waits for shards
+    const OrdinalSet* const status_ordinals = GetStatusOrdinals(document_predicate);
+    OrdinalSet excluded = std::move(GetThreadQueryContext().excluded_ordinals_);
+    MakeExcludedOrdinals(query.minus_words, excluded);
+
+    const size_t shard_count = GetShardCount();
+    std::vector<std::vector<Document>> shard_documents(shard_count);
+
+    ThreadPool::GetDefault().ParallelFor(0, shard_count,
+        [&](size_t shard) {
+            const auto [first, last] = GetShardRange(shard, shard_count);
+
+            // zero relevance is a valid score, so matched documents are flagged separately
+            thread_local std::vector<double> relevances;
+            thread_local std::vector<char> is_matched;
+            thread_local std::vector<int> matched_ordinals;
+            if (relevances.size() < static_cast<size_t>(last - first)) {
+                relevances.resize(last - first, 0.0);
+                is_matched.resize(last - first, false);
+            }
+            matched_ordinals.clear();
+
+            for (const auto& [term_id, weight] : plus_terms) {
+                auto postings = index_.GetPostings(term_id, first);
+                for (; !postings.IsEnd() && postings.GetOrdinal() < last; postings.Next()) {
+                    const int ordinal = postings.GetOrdinal();
+                    if ((status_ordinals ? !status_ordinals->Contains(ordinal)
+                            : !document_predicate(ordinal_to_document_id_[ordinal], document_statuses_[ordinal], document_ratings_[ordinal])) ||
+                        excluded.Contains(ordinal)) {
+                        continue;
+                    }
+                    if (!is_matched[ordinal - first]) {
+                        is_matched[ordinal - first] = true;
+                        matched_ordinals.push_back(ordinal);
                     }
-                }//*/
+                    relevances[ordinal - first] += ranking.GetScore(weight, postings);
+                }
+            }
+
+            auto& documents = shard_documents[shard];
+            for (const int ordinal : matched_ordinals) {
+                documents.push_back({ ordinal_to_document_id_[ordinal], relevances[ordinal - first], document_ratings_[ordinal] });
+                relevances[ordinal - first] = 0.0;
+                is_matched[ordinal - first] = false;
             }
         });
 
-    for (const std::string_view word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
+    // concatenation of shards: offsets by prefix sums, copies in parallel
+    std::vector<size_t> shard_offsets(shard_count + 1, 0);
+    for (size_t shard = 0; shard < shard_count; ++shard) {
+        shard_offsets[shard + 1] = shard_offsets[shard] + shard_documents[shard].size();
+    }
+    std::vector<Document> matched_documents(shard_offsets.back());
+    ThreadPool::GetDefault().ParallelFor(0, shard_count,
+        [&](size_t shard) {
+            std::copy(shard_documents[shard].begin(), shard_documents[shard].end(), matched_documents.begin() + shard_offsets[shard]);
+        });
+    GetThreadQueryContext().excluded_ordinals_ = std::move(excluded);
+
+    return matched_documents;
+}
+
+template <typename Predicate>
+const OrdinalSet* SearchServer::GetStatusOrdinals(const Predicate& document_predicate) const {
+    if constexpr (std::is_same_v<Predicate, StatusPredicate>) {
+        return &status_ordinals_[static_cast<size_t>(document_predicate.status)];
+    }
+    else {
+        return nullptr;
+    }
+}
+
+template <typename Ranking>
+void SearchServer::MakeTermCursors(const std::vector<std::string_view>& words, std::vector<TermCursor>& cursors) const {
+    const Ranking ranking{};
+    cursors.clear();
+    for (const std::string_view word : words) {
+        const int term_id = index_.FindTerm(word);
+        if (term_id == InvertedIndex::NO_TERM || index_.GetDocumentFreq(term_id) == 0) {
             continue;
         }
+        const TermWeight weight = ranking.GetTermWeight(GetTermStatistics(term_id));
+        cursors.push_back({ index_.GetPostings(term_id), weight, ranking.GetMaxScore(weight, index_.GetScoreBounds(term_id)), term_id });
+    }
+}
 
-        for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-            document_to_relevance.Erase(document_id);
+template <typename Ranking>
+bool SearchServer::MakeRequiredCursors(const Query& query, QueryContext& context) const {
+    if (!MakePhraseTerms(query, context.phrase_terms_, context.phrase_ends_)) {
+        return false;
+    }
+    MakeTermCursors<Ranking>(query.plus_words, context.cursors_);
+    MakeTermCursors<Ranking>(query.minus_words, context.minus_cursors_);
+    MakeProximityTerms(query, context.cursors_, context.proximity_terms_);
+
+    // lists of required words and words of phrases are intersected from the shortest one
+    std::vector<int>& term_ids = context.required_term_ids_;
+    term_ids.clear();
+    for (const std::string_view word : query.required_words) {
+        const int term_id = index_.FindTerm(word);
+        if (term_id == InvertedIndex::NO_TERM || index_.GetDocumentFreq(term_id) == 0) {
+            return false;
         }
+        term_ids.push_back(term_id);
     }
+    for (const PhraseTerm& term : context.phrase_terms_) {
+        term_ids.push_back(term.term_id);
+    }
+    std::sort(term_ids.begin(), term_ids.end(), [this](int lhs, int rhs) {
+        const size_t lhs_freq = index_.GetDocumentFreq(lhs);
+        const size_t rhs_freq = index_.GetDocumentFreq(rhs);
+        return lhs_freq != rhs_freq ? lhs_freq < rhs_freq : lhs < rhs;
+        });
+    term_ids.erase(std::unique(term_ids.begin(), term_ids.end()), term_ids.end());
+    return !context.cursors_.empty();
+}
 
-    std::vector<Document> matched_documents;
-    for (const auto [document_id, relevance] : document_to_relevance.BuildOrdinaryMap()) {
-        matched_documents.push_back({ document_id, relevance, documents_.at(document_id).rating });
+template <typename Ranking, typename Predicate>
+void SearchServer::FindRequiredDocuments(QueryContext& context, Predicate document_predicate, int first_ordinal, int last_ordinal) const {
+    const Ranking ranking{};
+    std::vector<TermCursor>& cursors = context.cursors_;
+    std::vector<TermCursor>& minus_cursors = context.minus_cursors_;
+    std::vector<double>& scores = context.scores_;
+    std::vector<Document>& matched_documents = context.documents_;
+    matched_documents.clear();
+    scores.resize(cursors.size());
+
+    auto add_document = [&](int ordinal) {
+        const int document_id = ordinal_to_document_id_[ordinal];
+        if (!document_predicate(document_id, document_statuses_[ordinal], document_ratings_[ordinal]) ||
+            std::any_of(minus_cursors.begin(), minus_cursors.end(), [ordinal](TermCursor& cursor) { return cursor.Seek(ordinal); })) {
+            return;
+        }
+        for (size_t i = 0; i < context.phrase_ends_.size(); ++i) {
+            const PhraseTerm* const terms = context.phrase_terms_.data();
+            if (!FindPhrase(ordinal, terms + (i > 0 ? context.phrase_ends_[i - 1] : 0), terms + context.phrase_ends_[i], context.term_positions_)) {
+                return;
+            }
+        }
+
+        double relevance = 0.0;
+        for (size_t i = 0; i < cursors.size(); ++i) {
+            scores[i] = cursors[i].Seek(ordinal) ? ranking.GetScore(cursors[i].weight, cursors[i].postings) : 0.0;
+            relevance += scores[i];
+        }
+        for (const ProximityTerms& terms : context.proximity_terms_) {
+            if (scores[terms.lhs] != 0.0 && scores[terms.rhs] != 0.0 &&
+                AreNear(ordinal, cursors[terms.lhs].term_id, cursors[terms.rhs].term_id, terms.distance, context.term_positions_)) {
+                relevance += PROXIMITY_BOOST * (scores[terms.lhs] + scores[terms.rhs]);
+            }
+        }
+        matched_documents.push_back({ document_id, relevance, document_ratings_[ordinal] });
+    };
+
+    std::vector<InvertedIndex::PostingIterator>& postings = context.required_postings_;
+    postings.clear();
+    for (const int term_id : context.required_term_ids_) {
+        postings.push_back(index_.GetPostings(term_id, first_ordinal));
     }
 
-    return matched_documents;
+    if (postings.empty()) {
+        // without required words every document of some plus word is a candidate
+        for (int ordinal = first_ordinal;; ++ordinal) {
+            int next_ordinal = last_ordinal;
+            for (TermCursor& cursor : cursors) {
+                cursor.Seek(ordinal);
+                if (!cursor.IsEnd()) {
+                    next_ordinal = std::min(next_ordinal, cursor.GetOrdinal());
+                }
+            }
+            if (next_ordinal >= last_ordinal) {
+                break;
+            }
+            ordinal = next_ordinal;
+            add_document(ordinal);
+        }
+        return;
+    }
+
+    for (int ordinal = first_ordinal; ordinal < last_ordinal; ++ordinal) {
+        // leapfrog: every list moves to the current ordinal, the one which skips it raises the ordinal,
+        // and the rest follow until all of them agree
+        for (size_t i = 0, agreed = 0; agreed < postings.size(); i = (i + 1) % postings.size()) {
+            if (postings[i].Seek(ordinal)) {
+                ++agreed;
+            }
+            else if (postings[i].IsEnd()) {
+                return;
+            }
+            else {
+                ordinal = postings[i].GetOrdinal();
+                if (ordinal >= last_ordinal) {
+                    return;
+                }
+                agreed = 1;
+            }
+        }
+        add_document(ordinal);
+    }
 }
 
+// shards share prepared cursors, every one of them collects all its matched documents
+template <typename Ranking, typename Predicate>
+std::vector<Document> SearchServer::FindRequiredDocuments(const std::execution::parallel_policy& policy, const Query& query, Predicate document_predicate) const {
+    QueryContext prepared_context;
+    if (!MakeRequiredCursors<Ranking>(query, prepared_context)) {
+        return {};
+    }
+
+    const size_t shard_count = GetShardCount();
+    std::vector<std::vector<Document>> shard_documents(shard_count);
+    ThreadPool::GetDefault().ParallelFor(0, shard_count,
+        [&](size_t shard) {
+            const auto [first, last] = GetShardRange(shard, shard_count);
+            QueryContext context = prepared_context;
+            FindRequiredDocuments<Ranking>(context, document_predicate, first, last);
+            shard_documents[shard] = std::move(context.documents_);
+        });
+
+    std::vector<Document> matched_documents;
+    for (const auto& documents : shard_documents) {
+        matched_documents.insert(matched_documents.end(), documents.begin(), documents.end());
+    }
+    return matched_documents;
+}
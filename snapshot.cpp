@@ -0,0 +1,136 @@
+#include "snapshot.h"
+
+#include <cstdio>
+
+#ifdef _WIN32
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::string& path) {
+    std::ifstream input(path, std::ios::binary);
+    if (!input) {
+        throw std::runtime_error("Can't open " + path);
+    }
+    buffer_.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+}
+
+MappedFile::~MappedFile() = default;
+#else
+MappedFile::MappedFile(const std::string& path) {
+    const int file = open(path.c_str(), O_RDONLY);
+    if (file < 0) {
+        throw std::runtime_error("Can't open " + path);
+    }
+    struct stat file_stat;
+    if (fstat(file, &file_stat) != 0) {
+        close(file);
+        throw std::runtime_error("Can't read " + path);
+    }
+    size_ = static_cast<size_t>(file_stat.st_size);
+    if (size_ > 0) {
+        void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, file, 0);
+        if (data == MAP_FAILED) {
+            close(file);
+            throw std::runtime_error("Can't map " + path);
+        }
+        data_ = static_cast<const char*>(data);
+    }
+    // mapping stays valid without the descriptor
+    close(file);
+}
+
+MappedFile::~MappedFile() {
+    if (data_ != nullptr) {
+        munmap(const_cast<char*>(data_), size_);
+    }
+}
+#endif
+
+std::string_view MappedFile::GetData() const {
+    return { data_, size_ };
+}
+
+SnapshotWriter::SnapshotWriter(const std::string& path)
+    : path_(path)
+    , temporary_path_(path + ".tmp")
+    , output_(temporary_path_, std::ios::binary | std::ios::trunc)
+{
+    if (!output_) {
+        throw std::runtime_error("Can't open " + temporary_path_);
+    }
+}
+
+SnapshotWriter::~SnapshotWriter() {
+    if (!is_finished_) {
+        output_.close();
+        std::remove(temporary_path_.c_str());
+    }
+}
+
+void SnapshotWriter::WriteString(const std::string_view value) {
+    Write<uint32_t>(static_cast<uint32_t>(value.size()));
+    WriteBytes(value.data(), value.size());
+}
+
+void SnapshotWriter::Finish() {
+    output_.close();
+    if (!output_) {
+        throw std::runtime_error("Can't write snapshot");
+    }
+#ifdef _WIN32
+    // rename doesn't replace existing file here, and loaded server holds a copy, not a mapping
+    std::remove(path_.c_str());
+#else
+    // data must be on disk before rename makes it visible under path
+    const int file = open(temporary_path_.c_str(), O_RDONLY);
+    if (file < 0) {
+        throw std::runtime_error("Can't open " + temporary_path_);
+    }
+    const bool is_synced = fsync(file) == 0;
+    close(file);
+    if (!is_synced) {
+        throw std::runtime_error("Can't sync " + temporary_path_);
+    }
+#endif
+    // server loaded from path keeps mapping of the old file, it is freed when mapping is
+    if (std::rename(temporary_path_.c_str(), path_.c_str()) != 0) {
+        throw std::runtime_error("Can't rename " + temporary_path_ + " to " + path_);
+    }
+    is_finished_ = true;
+}
+
+void SnapshotWriter::WriteBytes(const void* data, size_t size) {
+    output_.write(static_cast<const char*>(data), size);
+    position_ += size;
+}
+
+SnapshotReader::SnapshotReader(const std::string_view data)
+    : data_(data)
+{
+}
+
+std::string_view SnapshotReader::ReadString() {
+    const uint32_t size = Read<uint32_t>();
+    return { Take(size), size };
+}
+
+bool SnapshotReader::IsEnd() const {
+    return position_ == data_.size();
+}
+
+const char* SnapshotReader::Take(size_t size) {
+    if (size > data_.size() - position_) {
+        throw std::invalid_argument("Snapshot is truncated");
+    }
+    const char* result = data_.data() + position_;
+    position_ += size;
+    return result;
+}
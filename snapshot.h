@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// format of SearchServer snapshot, version is changed with every change of layout
+constexpr std::string_view SNAPSHOT_MAGIC = "SRCHSNAP";
+constexpr uint32_t SNAPSHOT_VERSION = 5;
+// written as is, so snapshot of other byte order is rejected
+constexpr uint32_t SNAPSHOT_BYTE_ORDER_MARK = 0x01020304;
+
+// read-only file mapped into memory, pages are shared with other processes reading it
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    std::string_view GetData() const;
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    // no mmap, file is read into memory
+    std::string buffer_;
+#endif
+};
+
+// values are written in native layout without padding, but aligned arrays. They go to path + ".tmp",
+// which replaces path only in Finish, so file still mapped by loaded server is never changed in place
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(const std::string& path);
+    // temporary file is removed if Finish was not done
+    ~SnapshotWriter();
+
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    template <typename T>
+    void Write(const T& value);
+    template <typename T>
+    void WriteArray(const std::vector<T>& values);
+    // array starts at offset from the beginning of file aligned for T, so reader can use it in place
+    template <typename T>
+    void WriteAlignedArray(const T* values, size_t size);
+    void WriteString(const std::string_view value);
+    // flushes and syncs temporary file to disk and renames it over path, throws if anything failed
+    void Finish();
+
+private:
+    std::string path_;
+    std::string temporary_path_;
+    std::ofstream output_;
+    bool is_finished_ = false;
+    uint64_t position_ = 0;
+
+    void WriteBytes(const void* data, size_t size);
+};
+
+// reads values in order they were written, throws std::invalid_argument on truncated data
+class SnapshotReader {
+public:
+    explicit SnapshotReader(const std::string_view data);
+
+    template <typename T>
+    T Read();
+    // values are copied, because data in file is not aligned
+    template <typename T>
+    void ReadArray(std::vector<T>& values);
+    // view into the data, data must start at the beginning of file and be aligned as mapped file is
+    template <typename T>
+    const T* ReadAlignedArray(size_t& size);
+    // view into the data
+    std::string_view ReadString();
+    bool IsEnd() const;
+
+private:
+    std::string_view data_;
+    size_t position_ = 0;
+
+    const char* Take(size_t size);
+};
+
+template <typename T>
+void SnapshotWriter::Write(const T& value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    WriteBytes(&value, sizeof(T));
+}
+
+template <typename T>
+void SnapshotWriter::WriteArray(const std::vector<T>& values) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    Write<uint64_t>(values.size());
+    WriteBytes(values.data(), values.size() * sizeof(T));
+}
+
+template <typename T>
+void SnapshotWriter::WriteAlignedArray(const T* values, size_t size) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    Write<uint64_t>(size);
+    const char padding[alignof(T)] = {};
+    WriteBytes(padding, (alignof(T) - position_ % alignof(T)) % alignof(T));
+    WriteBytes(values, size * sizeof(T));
+}
+
+template <typename T>
+T SnapshotReader::Read() {
+    static_assert(std::is_trivially_copyable_v<T>);
+    T value;
+    std::memcpy(&value, Take(sizeof(T)), sizeof(T));
+    return value;
+}
+
+template <typename T>
+void SnapshotReader::ReadArray(std::vector<T>& values) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    const uint64_t size = Read<uint64_t>();
+    if (size > (data_.size() - position_) / sizeof(T)) {
+        throw std::invalid_argument("Snapshot is truncated");
+    }
+    values.resize(size);
+    if (size > 0) {
+        std::memcpy(values.data(), Take(size * sizeof(T)), size * sizeof(T));
+    }
+}
+
+template <typename T>
+const T* SnapshotReader::ReadAlignedArray(size_t& size) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    const uint64_t array_size = Read<uint64_t>();
+    Take((alignof(T) - position_ % alignof(T)) % alignof(T));
+    if (array_size > (data_.size() - position_) / sizeof(T)) {
+        throw std::invalid_argument("Snapshot is truncated");
+    }
+    size = static_cast<size_t>(array_size);
+    return reinterpret_cast<const T*>(Take(size * sizeof(T)));
+}
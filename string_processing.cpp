@@ -1,19 +1,127 @@
 #include "string_processing.h"
 
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 using namespace std;
 
-vector<string_view> SplitIntoWords(string_view text)
+namespace {
+
+int CountTrailingZeros(uint64_t value) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(value);
+#endif
+}
+
+// text is scanned by blocks of up to 64 bytes, bit i of the mask is set if byte i of the block is a space
+class WordScanner {
+public:
+    WordScanner(string_view text, vector<string_view>& words)
+        : text_(text)
+        , words_(words)
+    {
+    }
+
+    void AddBlock(size_t block_begin, size_t block_size, uint64_t spaces) {
+        // words start and end where the mask changes
+        uint64_t boundaries = (spaces ^ ((spaces << 1) | (previous_space_ ? 1 : 0)));
+        if (block_size < 64) {
+            boundaries &= (uint64_t{ 1 } << block_size) - 1;
+        }
+        bool in_word = !previous_space_;
+        while (boundaries != 0) {
+            const size_t position = block_begin + CountTrailingZeros(boundaries);
+            if (in_word) {
+                words_.emplace_back(text_.data() + word_begin_, position - word_begin_);
+            }
+            else {
+                word_begin_ = position;
+            }
+            in_word = !in_word;
+            boundaries &= boundaries - 1;
+        }
+        previous_space_ = ((spaces >> (block_size - 1)) & 1) != 0;
+    }
+
+    void Finish() {
+        if (!previous_space_) {
+            words_.emplace_back(text_.data() + word_begin_, text_.size() - word_begin_);
+        }
+    }
+
+private:
+    string_view text_;
+    vector<string_view>& words_;
+    size_t word_begin_ = 0;
+    // text is treated as if it starts after a space
+    bool previous_space_ = true;
+};
+
+}  // namespace
+
+bool SplitIntoWords(string_view text, vector<string_view>& words)
 {
-    vector<string_view> result;
-    text.remove_prefix(std::min(text.find_first_not_of(" "), text.size()));
-    while (true) {
-        auto space = text.find(' ');
-        result.push_back(space == text.npos ? text.substr(0, text.npos) : text.substr(0, space));
-        text.remove_prefix(std::min(text.find_first_not_of(" ", space), text.size()));
-        if (space == text.npos) {
-            break;
+    words.clear();
+    WordScanner scanner(text, words);
+    size_t position = 0;
+    bool has_control = false;
+
+    // control character is a byte less than ' ', min(byte, ' ' - 1) == byte for them
+#if defined(__AVX2__)
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i max_control = _mm256_set1_epi8(' ' - 1);
+    __m256i control = _mm256_setzero_si256();
+    for (; position + 32 <= text.size(); position += 32) {
+        const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text.data() + position));
+        const uint32_t spaces = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, space)));
+        control = _mm256_or_si256(control, _mm256_cmpeq_epi8(_mm256_min_epu8(block, max_control), block));
+        scanner.AddBlock(position, 32, spaces);
+    }
+    has_control = !_mm256_testz_si256(control, control);
+#elif defined(__SSE2__) || defined(_M_X64)
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i max_control = _mm_set1_epi8(' ' - 1);
+    __m128i control = _mm_setzero_si128();
+    for (; position + 16 <= text.size(); position += 16) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + position));
+        const uint32_t spaces = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, space)));
+        control = _mm_or_si128(control, _mm_cmpeq_epi8(_mm_min_epu8(block, max_control), block));
+        scanner.AddBlock(position, 16, spaces);
+    }
+    has_control = _mm_movemask_epi8(control) != 0;
+#endif
+
+    // the rest of text (or all of it without SIMD)
+    for (; position < text.size(); position += 64) {
+        const size_t block_size = std::min<size_t>(64, text.size() - position);
+        uint64_t spaces = 0;
+        for (size_t i = 0; i < block_size; ++i) {
+            const unsigned char c = static_cast<unsigned char>(text[position + i]);
+            spaces |= uint64_t{ c == ' ' } << i;
+            has_control |= c < ' ';
         }
+        scanner.AddBlock(position, block_size, spaces);
     }
-    return result;
+    scanner.Finish();
+    return !has_control;
+}
 
+vector<string_view> SplitIntoWords(string_view text)
+{
+    vector<string_view> result;
+    SplitIntoWords(text, result);
+    return result;
 }
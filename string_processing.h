@@ -6,6 +6,9 @@
 #include <type_traits>
 #include <vector>
 
+// non-empty words separated by spaces are written into words (previous content is cleared),
+// returns false if text contains control characters (they don't separate words)
+bool SplitIntoWords(std::string_view text, std::vector<std::string_view>& words);
 std::vector<std::string_view> SplitIntoWords(std::string_view text);
 
 template <typename StringContainer>
@@ -0,0 +1,169 @@
+#include "term_dictionary.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <utility>
+
+TermDictionary::ArenaBlock::ArenaBlock(size_t block_size)
+    : data(new char[block_size])
+    , size(block_size)
+{
+}
+
+int TermDictionary::Find(std::string_view word) const {
+    if (slots_.empty()) {
+        return NO_TERM;
+    }
+    const uint32_t slot = slots_[FindSlot(word, Hash(word))];
+    return slot == EMPTY_SLOT ? NO_TERM : static_cast<int>(slot - 1);
+}
+
+int TermDictionary::Add(std::string_view word) {
+    // at most half of slots are taken, so probes stay short
+    if (2 * (static_cast<size_t>(size_) + 1) > slots_.size()) {
+        Grow();
+    }
+    const uint32_t hash = Hash(word);
+    const size_t slot = FindSlot(word, hash);
+    if (slots_[slot] != EMPTY_SLOT) {
+        return static_cast<int>(slots_[slot] - 1);
+    }
+
+    int term_id;
+    if (free_ids_.empty()) {
+        term_id = static_cast<int>(words_.size());
+        words_.emplace_back();
+        hashes_.push_back(0);
+    }
+    else {
+        term_id = free_ids_.back();
+        free_ids_.pop_back();
+    }
+    words_[term_id] = CopyToArena(word);
+    live_size_ += word.size();
+    hashes_[term_id] = hash;
+    slots_[slot] = static_cast<uint32_t>(term_id) + 1;
+    ++size_;
+    return term_id;
+}
+
+void TermDictionary::Remove(int term_id) {
+    const size_t mask = GetSlotMask();
+    size_t slot = FindSlot(words_[term_id], hashes_[term_id]);
+    // backward shift deletion: following words which may not be found across the hole are moved into it
+    for (size_t next = (slot + 1) & mask; slots_[next] != EMPTY_SLOT; next = (next + 1) & mask) {
+        const size_t home = hashes_[slots_[next] - 1] & mask;
+        if (((next - home) & mask) >= ((next - slot) & mask)) {
+            slots_[slot] = slots_[next];
+            slot = next;
+        }
+    }
+    slots_[slot] = EMPTY_SLOT;
+
+    live_size_ -= words_[term_id].size();
+    dead_size_ += words_[term_id].size();
+    words_[term_id] = {};
+    free_ids_.push_back(term_id);
+    --size_;
+}
+
+std::string_view TermDictionary::GetWord(int term_id) const {
+    return words_[term_id];
+}
+
+int TermDictionary::GetSize() const {
+    return size_;
+}
+
+int TermDictionary::GetIdLimit() const {
+    return static_cast<int>(words_.size());
+}
+
+bool TermDictionary::NeedsCompaction() const {
+    return dead_size_ >= ARENA_BLOCK_SIZE && dead_size_ > live_size_;
+}
+
+void TermDictionary::Compact() {
+    // words are read from old blocks while they are copied
+    const std::vector<std::shared_ptr<ArenaBlock>> old_blocks = std::move(arena_blocks_);
+    arena_blocks_.clear();
+    last_block_.reset();
+    for (std::string_view& word : words_) {
+        if (!word.empty()) {
+            word = CopyToArena(word);
+        }
+    }
+    dead_size_ = 0;
+}
+
+size_t TermDictionary::GetArenaSize() const {
+    size_t size = 0;
+    for (const auto& block : arena_blocks_) {
+        size += block->size;
+    }
+    return size;
+}
+
+uint32_t TermDictionary::Hash(std::string_view word) {
+    const uint64_t hash = std::hash<std::string_view>{}(word);
+    return static_cast<uint32_t>(hash ^ (hash >> 32));
+}
+
+size_t TermDictionary::GetSlotMask() const {
+    return slots_.size() - 1;
+}
+
+size_t TermDictionary::FindSlot(std::string_view word, uint32_t hash) const {
+    const size_t mask = GetSlotMask();
+    size_t slot = hash & mask;
+    for (; slots_[slot] != EMPTY_SLOT; slot = (slot + 1) & mask) {
+        const uint32_t term_id = slots_[slot] - 1;
+        if (hashes_[term_id] == hash && words_[term_id] == word) {
+            break;
+        }
+    }
+    return slot;
+}
+
+void TermDictionary::Grow() {
+    std::vector<uint32_t> slots(std::max<size_t>(2 * slots_.size(), 16), EMPTY_SLOT);
+    const size_t mask = slots.size() - 1;
+    for (const uint32_t slot : slots_) {
+        if (slot != EMPTY_SLOT) {
+            size_t new_slot = hashes_[slot - 1] & mask;
+            while (slots[new_slot] != EMPTY_SLOT) {
+                new_slot = (new_slot + 1) & mask;
+            }
+            slots[new_slot] = slot;
+        }
+    }
+    slots_ = std::move(slots);
+}
+
+std::string_view TermDictionary::CopyToArena(std::string_view word) {
+    // long words get a block of their own, the rest of the last block is still used
+    if (word.size() > ARENA_BLOCK_SIZE / 4) {
+        auto& block = arena_blocks_.emplace_back(std::make_shared<ArenaBlock>(word.size()));
+        block->used_size = word.size();
+        std::memcpy(block->data.get(), word.data(), word.size());
+        return { block->data.get(), word.size() };
+    }
+    char* data = last_block_ ? TakeBytes(*last_block_, word.size()) : nullptr;
+    if (data == nullptr) {
+        last_block_ = arena_blocks_.emplace_back(std::make_shared<ArenaBlock>(ARENA_BLOCK_SIZE));
+        data = TakeBytes(*last_block_, word.size());
+    }
+    std::memcpy(data, word.data(), word.size());
+    return { data, word.size() };
+}
+
+char* TermDictionary::TakeBytes(ArenaBlock& block, size_t size) {
+    size_t used_size = block.used_size.load(std::memory_order_relaxed);
+    while (used_size + size <= block.size) {
+        if (block.used_size.compare_exchange_weak(used_size, used_size + size, std::memory_order_relaxed)) {
+            return block.data.get() + used_size;
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Words with 32-bit ids. Bytes of words are copied into an arena of large blocks, which are never
+// moved, so views returned by GetWord stay valid until the word is removed. Words are found by an
+// open addressing table of ids with linear probing, looked up by string_view.
+// Ids of removed words are given to new words. Written bytes are never changed, so copies share
+// the blocks: views of one dictionary stay valid in its copies. Bytes of removed words stay in blocks
+// until Compact.
+class TermDictionary {
+public:
+    static constexpr int NO_TERM = -1;
+
+    TermDictionary() = default;
+    // blocks are shared, the copy appends new words to the shared last block, ids are kept
+    TermDictionary(const TermDictionary& other) = default;
+    TermDictionary(TermDictionary&& other) = default;
+    TermDictionary& operator=(const TermDictionary& other) = default;
+    TermDictionary& operator=(TermDictionary&& other) = default;
+
+    // returns NO_TERM if word is not in dictionary
+    int Find(std::string_view word) const;
+    // id of non-empty word, it is added if it isn't in dictionary
+    int Add(std::string_view word);
+    void Remove(int term_id);
+
+    // empty for removed ids
+    std::string_view GetWord(int term_id) const;
+    // number of words
+    int GetSize() const;
+    // ids of words are less than it
+    int GetIdLimit() const;
+
+    // bytes of removed words are more than bytes of present ones and take at least a block
+    bool NeedsCompaction() const;
+    // present words are copied into new blocks, ids are kept. Views of words given before are valid
+    // only while a copy of dictionary made before still has the old blocks
+    void Compact();
+    // bytes of blocks held by dictionary, some of them may be written by its copies
+    size_t GetArenaSize() const;
+
+private:
+    static constexpr size_t ARENA_BLOCK_SIZE = 64 * 1024;
+    static constexpr uint32_t EMPTY_SLOT = 0;
+
+    // copies of dictionary append to the same block, every one takes its bytes by moving used_size
+    struct ArenaBlock {
+        explicit ArenaBlock(size_t block_size);
+
+        std::unique_ptr<char[]> data;
+        size_t size;
+        std::atomic<size_t> used_size = 0;
+    };
+
+    std::vector<std::shared_ptr<ArenaBlock>> arena_blocks_;
+    // block new words are appended to, blocks of long words are not
+    std::shared_ptr<ArenaBlock> last_block_;
+    // bytes of present and removed words of this dictionary
+    size_t live_size_ = 0;
+    size_t dead_size_ = 0;
+
+    std::vector<std::string_view> words_;
+    // hashes by id, they are compared before bytes and not computed again when table grows
+    std::vector<uint32_t> hashes_;
+    std::vector<int> free_ids_;
+    int size_ = 0;
+    // id + 1 or EMPTY_SLOT, size is power of two and at least twice the number of words
+    std::vector<uint32_t> slots_;
+
+    static uint32_t Hash(std::string_view word);
+    size_t GetSlotMask() const;
+    // slot of word or the empty slot where it should be
+    size_t FindSlot(std::string_view word, uint32_t hash) const;
+    void Grow();
+    std::string_view CopyToArena(std::string_view word);
+    // nullptr if block has no room for size bytes
+    static char* TakeBytes(ArenaBlock& block, size_t size);
+};
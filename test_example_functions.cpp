@@ -1,5 +1,9 @@
 #include "test_example_functions.h"
 
+#include <cstdio>
+#include <sstream>
+#include <thread>
+
 using namespace std::literals;
 
 void AddDocument(SearchServer& search_server, int document_id, const std::string& document, DocumentStatus status,
@@ -47,7 +51,9 @@ void Test01()
     using namespace std;
     {
         SearchServer search_server("and in at"s);
-        RequestQueue request_queue(search_server);
+        // каждый запрос приходит на минуту позже предыдущего
+        RequestQueue::Clock::time_point now;
+        RequestQueue request_queue(search_server, 24h, 1440, [&now] { return now; });
 
         search_server.AddDocument(1, "curly cat curly tail"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
         search_server.AddDocument(2, "curly dog and fancy collar"s, DocumentStatus::ACTUAL, { 1, 2, 3 });
@@ -57,13 +63,17 @@ void Test01()
 
         // 1439 запросов с нулевым результатом
         for (int i = 0; i < 1439; ++i) {
+            now += 1min;
             request_queue.AddFindRequest("empty request"s);
         }
         // все еще 1439 запросов с нулевым результатом
+        now += 1min;
         request_queue.AddFindRequest("curly dog"s);
         // новые сутки, первый запрос удален, 1438 запросов с нулевым результатом
+        now += 1min;
         request_queue.AddFindRequest("big collar"s);
         // первый запрос удален, 1437 запросов с нулевым результатом
+        now += 1min;
         request_queue.AddFindRequest("sparrow"s);
         cout << "Total empty requests: "s << request_queue.GetNoResultRequests() << endl;
         // проверка матчинга документов
@@ -281,6 +291,10 @@ void Test04()
         cout << "{"s << document.id << "} "s;
     }//*/
     cout << endl;
+    ProcessQueriesJoined(search_server, queries, [](const Document& document) {
+        cout << "{"s << document.id << "} "s;
+    });
+    cout << endl;
  /*   for (const Document& document : ProcessQueriesJoinedDeque(search_server, queries)) {
         //cout << "Document "s << document.id << " matched with relevance "s << document.relevance << endl;
     }//*/
@@ -658,3 +672,1361 @@ void Test11()
     TEST(par);//*/
     std::cout << "Test 11 is done!" << std::endl;
 }
+
+/* ------------------------- Test12 ------------------------- */
+void Test12()
+{
+    using namespace std;
+
+    std::cout << "Wait..." << std::endl;
+
+    mt19937 generator;
+
+    const auto dictionary = GenerateDictionary(generator, 1000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, 10'000, 70);
+
+    SearchServer search_server(dictionary[0]);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+    }
+
+    const auto queries = GenerateQueries(generator, dictionary, 100, 70);
+
+    const auto short_queries = GenerateQueries(generator, dictionary, 1000, 3);
+
+    search_server.SetRetrievalMode(RetrievalMode::EXHAUSTIVE);
+    Test("exhaustive"s, search_server, queries, execution::seq);
+    Test("exhaustive short"s, search_server, short_queries, execution::seq);
+    search_server.SetRetrievalMode(RetrievalMode::MAX_SCORE);
+    Test("max_score"s, search_server, queries, execution::seq);
+    Test("max_score short"s, search_server, short_queries, execution::seq);
+    Test("max_score par"s, search_server, queries, execution::par);
+    Test("max_score short par"s, search_server, short_queries, execution::par);
+    search_server.SetRetrievalMode(RetrievalMode::AUTO);
+    Test("auto"s, search_server, queries, execution::seq);
+    Test("auto short"s, search_server, short_queries, execution::seq);
+
+    // the same top in the same order, documents of equal relevance and rating go by id: the second server has
+    // every document twice, so ties are in every top
+    SearchServer tie_search_server(dictionary[0]);
+    for (size_t i = 0; i < 2'000; ++i) {
+        tie_search_server.AddDocument(2 * i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+        tie_search_server.AddDocument(2 * i + 1, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+    }
+    const auto get_ids = [](const vector<Document>& documents) {
+        vector<int> ids;
+        for (const Document& document : documents) {
+            ids.push_back(document.id);
+        }
+        return ids;
+    };
+    for (SearchServer* server : { &search_server, &tie_search_server }) {
+        int query_count = 0;
+        int mismatch_count = 0;
+        for (const auto* query_set : { &queries, &short_queries }) {
+            for (const string& query : *query_set) {
+                for (const size_t result_count : { size_t{ 5 }, size_t{ 50 } }) {
+                    vector<vector<int>> tops;
+                    for (const RetrievalMode mode : { RetrievalMode::EXHAUSTIVE, RetrievalMode::MAX_SCORE, RetrievalMode::AUTO }) {
+                        server->SetRetrievalMode(mode);
+                        tops.push_back(get_ids(server->FindTopDocuments(execution::seq, query, DocumentStatus::ACTUAL, result_count)));
+                        tops.push_back(get_ids(server->FindTopDocuments(execution::par, query, DocumentStatus::ACTUAL, result_count)));
+                    }
+                    ++query_count;
+                    mismatch_count += count(tops.begin(), tops.end(), tops.front()) != static_cast<int>(tops.size());
+                }
+            }
+        }
+        cout << (server == &search_server ? "max_score against exhaustive: "s : "with ties: "s)
+            << query_count << " queries, "s << mismatch_count << " mismatches"s << endl;
+    }
+    std::cout << "Test 12 is done!" << std::endl;
+}
+
+/* ------------------- BanchMark for Test13 -------------------- */
+// completion time of every query since start of the batch: p50, p99 and max
+void PrintLatencies(std::string_view mark, std::vector<double> latencies) {
+    using namespace std;
+    sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p) {
+        return latencies[static_cast<size_t>(p * (latencies.size() - 1))];
+    };
+    cout << mark << ": p50 = "s << percentile(0.5) << " ms, p99 = "s << percentile(0.99)
+        << " ms, max = "s << latencies.back() << " ms"s << endl;
+}
+
+/* ------------------------- Test13 ------------------------- */
+void Test13()
+{
+    using namespace std;
+    using Clock = chrono::steady_clock;
+
+    std::cout << "Wait..." << std::endl;
+
+    mt19937 generator;
+
+    const auto dictionary = GenerateDictionary(generator, 1000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, 10'000, 70);
+
+    SearchServer search_server(dictionary[0]);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+    }
+
+    // mostly short queries with long ones among them
+    vector<string> queries;
+    for (int i = 0; i < 2'000; ++i) {
+        queries.push_back(GenerateQuery(generator, dictionary, i % 20 == 0 ? 300 : 2));
+    }
+
+    vector<double> latencies(queries.size());
+    auto start = Clock::now();
+    auto process_query = [&](size_t i) {
+        search_server.FindTopDocuments(queries[i]);
+        latencies[i] = chrono::duration<double, milli>(Clock::now() - start).count();
+    };
+
+    vector<size_t> indices(queries.size());
+    iota(indices.begin(), indices.end(), 0);
+    start = Clock::now();
+    for_each(execution::par, indices.begin(), indices.end(), process_query);
+    PrintLatencies("execution::par"s, latencies);
+
+    ThreadPool thread_pool;
+    start = Clock::now();
+    thread_pool.ParallelFor(0, queries.size(), process_query);
+    PrintLatencies("thread pool"s, latencies);
+
+    std::cout << "Test 13 is done!" << std::endl;
+}
+
+/* ------------------------- Test14 ------------------------- */
+void Test14()
+{
+    using namespace std;
+
+    SearchServer search_server("and with"s);
+
+    int id = 0;
+    for (
+        const string& text : {
+            "funny pet and nasty rat"s,
+            "funny pet with curly hair"s,
+            "funny pet and not very nasty rat"s,
+            "pet with rat and rat and rat"s,
+            "nasty rat with curly hair"s,
+        }
+    ) {
+        search_server.AddDocument(++id, text, DocumentStatus::ACTUAL, {1, 2});
+    }
+
+    QueryCache query_cache(search_server);
+    auto report = [&query_cache](const string& query) {
+        const auto documents = query_cache.FindTopDocuments(query);
+        const auto statistics = query_cache.GetStatistics();
+        cout << documents.size() << " documents for query ["s << query << "], hits: "s << statistics.hits
+            << ", misses: "s << statistics.misses << endl;
+    };
+
+    report("curly hair"s);
+    // the same normalized query
+    report("hair curly curly"s);
+    report("nasty rat -not"s);
+    // new document drops cached results
+    search_server.AddDocument(++id, "curly dog"s, DocumentStatus::ACTUAL, {1, 2});
+    report("curly hair"s);
+
+    // cache is shared by workers of the pool
+    const vector<string> queries(1000, "funny pet -curly"s);
+    ThreadPool::GetDefault().ParallelFor(0, queries.size(),
+        [&query_cache, &queries](size_t i) { query_cache.FindTopDocuments(queries[i]); });
+    report("funny pet -curly"s);
+    cout << "Test 14 finished" << endl;
+}
+
+/* ------------------------- Test15 ------------------------- */
+void Test15()
+{
+    using namespace std;
+
+    std::cout << "Wait..." << std::endl;
+
+    mt19937 generator;
+
+    const auto dictionary = GenerateDictionary(generator, 1000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, 50'000, 70);
+
+    SearchServer search_server(dictionary[0]);
+    {
+        LOG_DURATION("AddDocument"s);
+        for (size_t i = 0; i < documents.size(); ++i) {
+            search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+        }
+    }
+
+    SearchServer bulk_search_server(dictionary[0]);
+    {
+        LOG_DURATION("AddDocuments"s);
+        vector<DocumentToAdd> documents_to_add;
+        documents_to_add.reserve(documents.size());
+        for (size_t i = 0; i < documents.size(); ++i) {
+            documents_to_add.push_back({ static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 } });
+        }
+        bulk_search_server.AddDocuments(documents_to_add);
+    }
+
+    const auto queries = GenerateQueries(generator, dictionary, 100, 10);
+    Test("one by one"s, search_server, queries, execution::seq);
+    Test("bulk"s, bulk_search_server, queries, execution::seq);
+
+    // nothing is added if one of documents is invalid
+    try {
+        bulk_search_server.AddDocuments({ { 50'000, "new document", DocumentStatus::ACTUAL, {} }, { 1, "old id", DocumentStatus::ACTUAL, {} } });
+    }
+    catch (const invalid_argument& e) {
+        cout << "Error: "s << e.what() << ", document count: "s << bulk_search_server.GetDocumentCount() << endl;
+    }
+    std::cout << "Test 15 is done!" << std::endl;
+}
+
+/* ------------------------- Test16 ------------------------- */
+void Test16()
+{
+    using namespace std;
+
+    std::cout << "Wait..." << std::endl;
+
+    mt19937 generator;
+
+    const auto dictionary = GenerateDictionary(generator, 1000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, 10'000, 70);
+
+    using Clock = chrono::steady_clock;
+    const auto to_milliseconds = [](Clock::duration duration) { return chrono::duration_cast<chrono::milliseconds>(duration).count(); };
+
+    const string path = "search_server.snapshot"s;
+    SearchServer saved_server(dictionary[0]);
+    const auto build_start = Clock::now();
+    for (size_t i = 0; i < documents.size(); ++i) {
+        saved_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+    }
+    // removed documents are saved as tombstones
+    for (int id = 0; id < 1000; ++id) {
+        saved_server.RemoveDocument(id * 10);
+    }
+    const auto build_duration = Clock::now() - build_start;
+    cerr << "AddDocument: "s << to_milliseconds(build_duration) << " ms"s << endl;
+    {
+        LOG_DURATION("SaveSnapshot"s);
+        saved_server.SaveSnapshot(path);
+    }
+
+    const auto queries = GenerateQueries(generator, dictionary, 100, 10);
+    const auto load_start = Clock::now();
+    SearchServer search_server = SearchServer::LoadSnapshot(path);
+    const auto load_duration = Clock::now() - load_start;
+    cerr << "LoadSnapshot: "s << to_milliseconds(load_duration) << " ms"s << endl;
+    cout << search_server.GetDocumentCount() << " documents loaded"s << endl;
+    // word frequencies are read document by document, documents are not tokenized again
+    cout << "LoadSnapshot is faster than AddDocument: "s << (load_duration < build_duration ? "yes"s : "no"s) << endl;
+    Test("loaded"s, search_server, queries, execution::seq);
+
+    // server is saved over the file it is mapped from, its segments keep reading the old file
+    search_server.SaveSnapshot(path);
+    const SearchServer reloaded_server = SearchServer::LoadSnapshot(path);
+    int mismatch_count = 0;
+    for (const string& query : queries) {
+        const auto expected = saved_server.FindTopDocuments(query);
+        const auto found = search_server.FindTopDocuments(query);
+        const auto reloaded = reloaded_server.FindTopDocuments(query);
+        const auto is_equal = [](const Document& lhs, const Document& rhs) { return lhs.id == rhs.id && lhs.relevance == rhs.relevance; };
+        mismatch_count += found.size() != expected.size() || !equal(found.begin(), found.end(), expected.begin(), is_equal)
+            || reloaded.size() != expected.size() || !equal(reloaded.begin(), reloaded.end(), expected.begin(), is_equal);
+    }
+    cout << "saved over own file and reloaded: "s << queries.size() << " queries, "s << mismatch_count << " mismatches"s << endl;
+
+    // segments of the file are merged with new ones and lose documents like segments in memory
+    for (size_t i = 0; i < documents.size(); ++i) {
+        saved_server.AddDocument(documents.size() + i, documents[i], DocumentStatus::ACTUAL, { 1, 2 });
+        search_server.AddDocument(documents.size() + i, documents[i], DocumentStatus::ACTUAL, { 1, 2 });
+    }
+    for (int id = 0; id < 2000; ++id) {
+        saved_server.RemoveDocument(id * 7 + 1);
+        search_server.RemoveDocument(id * 7 + 1);
+    }
+    mismatch_count = 0;
+    for (const string& query : queries) {
+        const auto expected = saved_server.FindTopDocuments(query);
+        const auto found = search_server.FindTopDocuments(query);
+        mismatch_count += found.size() != expected.size() || !equal(found.begin(), found.end(), expected.begin(),
+            [](const Document& lhs, const Document& rhs) { return lhs.id == rhs.id && lhs.relevance == rhs.relevance; });
+    }
+    cout << "loaded against saved: "s << queries.size() << " queries, "s << mismatch_count << " mismatches"s << endl;
+    remove(path.c_str());
+
+    try {
+        SearchServer::LoadSnapshot(path);
+    }
+    catch (const runtime_error& e) {
+        cout << "Error: "s << e.what() << endl;
+    }
+    std::cout << "Test 16 is done!" << std::endl;
+}
+
+/* ------------------------- Test17 ------------------------- */
+void Test17()
+{
+    using namespace std;
+
+    std::cout << "Wait..." << std::endl;
+
+    mt19937 generator;
+
+    const auto dictionary = GenerateDictionary(generator, 1000, 10);
+    const auto texts = GenerateQueries(generator, dictionary, 200'000, 10);
+
+    size_t word_count = 0;
+    {
+        LOG_DURATION("SplitIntoWords"s);
+        vector<string_view> words;
+        for (const string& text : texts) {
+            SplitIntoWords(text, words);
+            word_count += words.size();
+        }
+    }
+    cout << word_count << " words"s << endl;
+
+    SearchServer search_server("and with"s);
+    AddDocument(search_server, 1, "  funny pet   and nasty rat  "s, DocumentStatus::ACTUAL, { 1 });
+    FindTopDocuments(search_server, "nasty pet "s);
+    // control character is found far from the beginning of text
+    AddDocument(search_server, 2, "funny pet with curly hair and very long tail \x12"s, DocumentStatus::ACTUAL, { 1 });
+    FindTopDocuments(search_server, "curly hair and very long tail -nas\x12ty"s);
+    std::cout << "Test 17 is done!" << std::endl;
+}
+
+/* ------------------------- Test18 ------------------------- */
+void Test18()
+{
+    using namespace std;
+
+    std::cout << "Wait..." << std::endl;
+
+    mt19937 generator;
+
+    const auto dictionary = GenerateDictionary(generator, 1000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, 20'000, 70);
+
+    SearchServer search_server(dictionary[0]);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+    }
+
+    const auto queries = GenerateQueries(generator, dictionary, 1'000, 10);
+    SearchServer::QueryContext context;
+    for (const RetrievalMode mode : { RetrievalMode::MAX_SCORE, RetrievalMode::EXHAUSTIVE }) {
+        search_server.SetRetrievalMode(mode);
+        // the first pass grows buffers of context
+        Test("context"s, search_server, queries, context);
+        Test("seq"s, search_server, queries, execution::seq);
+
+        size_t first_count = GetAllocationCount();
+        for (const string_view query : queries) {
+            search_server.FindTopDocuments(context, query);
+        }
+        const size_t context_allocations = GetAllocationCount() - first_count;
+
+        first_count = GetAllocationCount();
+        for (const string_view query : queries) {
+            search_server.FindTopDocuments(query);
+        }
+        const size_t allocations = GetAllocationCount() - first_count;
+        cout << "allocations with context: "s << context_allocations << ", without context: "s << allocations << endl;
+    }
+    std::cout << "Test 18 is done!" << std::endl;
+}
+
+/* ------------------------- Test19 ------------------------- */
+void Test19()
+{
+    using namespace std;
+
+    std::cout << "Wait..." << std::endl;
+
+    mt19937 generator;
+
+    const auto dictionary = GenerateDictionary(generator, 1000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, 20'000, 70);
+
+    SearchServer search_server(dictionary[0]);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+    }
+
+    const auto queries = GenerateQueries(generator, dictionary, 1'000, 10);
+    // top of MaxScore is the same as of exhaustive search for every ranking
+    auto run = [&](string_view mark, auto search) {
+        LOG_DURATION(mark);
+        double total_relevance = 0;
+        for (const string_view query : queries) {
+            for (const Document& document : search(query)) {
+                total_relevance += document.relevance;
+            }
+        }
+        cout << total_relevance << endl;
+    };
+    for (const RetrievalMode mode : { RetrievalMode::MAX_SCORE, RetrievalMode::EXHAUSTIVE }) {
+        search_server.SetRetrievalMode(mode);
+        run("tf-idf"s, [&](string_view query) { return search_server.FindTopDocuments<TfIdf>(execution::seq, query); });
+        run("bm25"s, [&](string_view query) { return search_server.FindTopDocuments<Bm25>(execution::seq, query); });
+        run("bm25 par"s, [&](string_view query) { return search_server.FindTopDocuments<Bm25>(execution::par, query); });
+    }
+
+    SearchServer small_search_server("and with"s);
+    AddDocument(small_search_server, 1, "white cat and fashionable collar"s, DocumentStatus::ACTUAL, { 8, -3 });
+    AddDocument(small_search_server, 2, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+    AddDocument(small_search_server, 3, "groomed dog expressive eyes and fluffy fluffy fluffy tail with long long ears"s, DocumentStatus::ACTUAL, { 5, -12, 2, 1 });
+    for (const Document& document : small_search_server.FindTopDocuments<Bm25>("fluffy groomed cat"s)) {
+        PrintDocument(document);
+    }
+    std::cout << "Test 19 is done!" << std::endl;
+}
+
+/* ------------------------- Test20 ------------------------- */
+void Test20()
+{
+    using namespace std;
+    using Clock = chrono::steady_clock;
+
+    std::cout << "Wait..." << std::endl;
+
+    mt19937 generator;
+
+    const auto dictionary = GenerateDictionary(generator, 1000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, 20'000, 70);
+    const auto queries = GenerateQueries(generator, dictionary, 1'000, 10);
+    const int initial_count = 10'000;
+    const int batch_size = 1'000;
+    const int reader_count = 2;
+
+    auto make_batch = [&](int first) {
+        vector<DocumentToAdd> batch;
+        for (int id = first; id < first + batch_size; ++id) {
+            batch.push_back({ id, documents[id], DocumentStatus::ACTUAL, { 1, 2, 3 } });
+        }
+        return batch;
+    };
+    SearchServer initial_search_server(dictionary[0]);
+    for (int id = 0; id < initial_count; id += batch_size) {
+        initial_search_server.AddDocuments(make_batch(id));
+    }
+
+    // readers search until the writer has added all documents by batches
+    auto stress = [&](string_view mark, auto search, auto add_documents) {
+        atomic<bool> is_writing = true;
+        vector<vector<double>> latencies(reader_count);
+        vector<thread> readers;
+        for (int reader = 0; reader < reader_count; ++reader) {
+            readers.emplace_back([&, reader] {
+                for (size_t i = reader; is_writing; i = (i + 1) % queries.size()) {
+                    const auto start = Clock::now();
+                    search(queries[i]);
+                    latencies[reader].push_back(chrono::duration<double, milli>(Clock::now() - start).count());
+                }
+            });
+        }
+        {
+            LOG_DURATION(string(mark) + " ingestion"s);
+            for (int id = initial_count; id < static_cast<int>(documents.size()); id += batch_size) {
+                add_documents(make_batch(id));
+            }
+        }
+        is_writing = false;
+        for (thread& reader : readers) {
+            reader.join();
+        }
+        for (size_t reader = 1; reader < latencies.size(); ++reader) {
+            latencies[0].insert(latencies[0].end(), latencies[reader].begin(), latencies[reader].end());
+        }
+        PrintLatencies(mark, latencies[0]);
+    };
+
+    {
+        SearchServer search_server = initial_search_server;
+        mutex search_server_mutex;
+        stress("global lock"s,
+            [&](const string& query) {
+                lock_guard lock(search_server_mutex);
+                return search_server.FindTopDocuments(query);
+            },
+            [&](const vector<DocumentToAdd>& batch) {
+                lock_guard lock(search_server_mutex);
+                search_server.AddDocuments(batch);
+            });
+        cout << search_server.GetDocumentCount() << " documents"s << endl;
+    }
+    {
+        ConcurrentSearchServer search_server(initial_search_server);
+        stress("read-copy-update"s,
+            [&](const string& query) {
+                return search_server.GetSnapshot()->FindTopDocuments(query);
+            },
+            [&](const vector<DocumentToAdd>& batch) {
+                search_server.AddDocuments(batch);
+            });
+        cout << search_server.GetSnapshot()->GetDocumentCount() << " documents"s << endl;
+
+        // invalid batch doesn't change published version
+        try {
+            search_server.AddDocument(0, "duplicate id"s, DocumentStatus::ACTUAL, {});
+        }
+        catch (const invalid_argument& e) {
+            cout << "Error: "s << e.what() << ", document count: "s << search_server.GetSnapshot()->GetDocumentCount() << endl;
+        }
+    }
+    std::cout << "Test 20 is done!" << std::endl;
+}
+
+/* ------------------------- Test21 ------------------------- */
+void Test21()
+{
+    using namespace std;
+
+    std::cout << "Wait..." << std::endl;
+
+    mt19937 generator;
+
+    const auto dictionary = GenerateDictionary(generator, 1000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, 50'000, 70);
+
+    SearchServer search_server(dictionary[0]);
+    {
+        LOG_DURATION("AddDocument"s);
+        for (size_t i = 0; i < documents.size(); ++i) {
+            search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+        }
+    }
+    {
+        // removed documents are only marked, posting lists are not rewritten
+        LOG_DURATION("RemoveDocument"s);
+        for (int id = 0; id < 40'000; id += 4) {
+            search_server.RemoveDocument(id);
+        }
+    }
+
+    const auto queries = GenerateQueries(generator, dictionary, 1'000, 10);
+    Test("with tombstones"s, search_server, queries, execution::seq);
+    {
+        LOG_DURATION("Flush"s);
+        search_server.Flush();
+    }
+    cout << search_server.GetSegmentCount() << " segments"s << endl;
+    // merges dropped postings of removed documents, results are the same
+    Test("merged"s, search_server, queries, execution::seq);
+    Test("merged par"s, search_server, queries, execution::par);
+
+    SearchServer fresh_search_server(dictionary[0]);
+    for (const int id : search_server) {
+        fresh_search_server.AddDocument(id, documents[id], DocumentStatus::ACTUAL, { 1, 2, 3 });
+    }
+    Test("fresh"s, fresh_search_server, queries, execution::seq);
+    std::cout << "Test 21 is done!" << std::endl;
+}
+
+/* ------------------------- Test22 ------------------------- */
+void Test22()
+{
+    using namespace std;
+
+    std::cout << "Wait..." << std::endl;
+
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1000, 10);
+
+    // after original documents go their copies with shuffled words and with a few words replaced
+    const auto generate_documents = [&](int original_count, int copy_count) {
+        auto documents = GenerateQueries(generator, dictionary, original_count, 70);
+        for (int i = 0; i < copy_count; ++i) {
+            const string original = documents[uniform_int_distribution<int>(0, original_count - 1)(generator)];
+            vector<string> words;
+            for (const string_view word : SplitIntoWords(original)) {
+                words.emplace_back(word);
+            }
+            shuffle(words.begin(), words.end(), generator);
+            if (i % 2 == 1) {
+                const int replaced_count = uniform_int_distribution<int>(1, 3)(generator);
+                for (int j = 0; j < replaced_count; ++j) {
+                    words[uniform_int_distribution<size_t>(0, words.size() - 1)(generator)] =
+                        dictionary[uniform_int_distribution<size_t>(0, dictionary.size() - 1)(generator)];
+                }
+            }
+            string copy;
+            for (const string& word : words) {
+                copy += copy.empty() ? word : " "s + word;
+            }
+            documents.push_back(move(copy));
+        }
+        return documents;
+    };
+    const auto make_server = [&](const vector<string>& documents) {
+        vector<DocumentToAdd> documents_to_add;
+        for (size_t i = 0; i < documents.size(); ++i) {
+            documents_to_add.push_back({ static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 } });
+        }
+        SearchServer search_server(dictionary[0]);
+        search_server.AddDocuments(documents_to_add);
+        return search_server;
+    };
+    // RemoveDuplicates prints every duplicate, the output is hidden and removed ids are returned
+    const auto remove_duplicates = [](SearchServer& search_server, auto... min_similarity) {
+        const set<int> document_ids(search_server.begin(), search_server.end());
+        ostringstream output;
+        streambuf* const cout_buffer = cout.rdbuf(output.rdbuf());
+        RemoveDuplicates(search_server, min_similarity...);
+        cout.rdbuf(cout_buffer);
+        vector<int> removed_ids;
+        set_difference(document_ids.begin(), document_ids.end(), search_server.begin(), search_server.end(), back_inserter(removed_ids));
+        return removed_ids;
+    };
+    const auto get_similarity = [](const map<string_view, double>& lhs, const map<string_view, double>& rhs) {
+        size_t common_count = 0;
+        auto lhs_it = lhs.begin();
+        auto rhs_it = rhs.begin();
+        while (lhs_it != lhs.end() && rhs_it != rhs.end()) {
+            if (lhs_it->first < rhs_it->first) {
+                ++lhs_it;
+            }
+            else if (rhs_it->first < lhs_it->first) {
+                ++rhs_it;
+            }
+            else {
+                ++common_count;
+                ++lhs_it;
+                ++rhs_it;
+            }
+        }
+        return static_cast<double>(common_count) / (lhs.size() + rhs.size() - common_count);
+    };
+
+    {
+        const auto documents = generate_documents(50'000, 20'000);
+        SearchServer search_server = make_server(documents);
+
+        // the old RemoveDuplicates: sets of words in std::set
+        vector<int> expected_ids;
+        {
+            LOG_DURATION("std::set"s);
+            set<set<string_view>> word_sets;
+            for (const int id : search_server) {
+                set<string_view> words;
+                for (const auto& [word, freq] : search_server.GetWordFrequencies(id)) {
+                    words.insert(word);
+                }
+                if (!word_sets.insert(move(words)).second) {
+                    expected_ids.push_back(id);
+                }
+            }
+        }
+        vector<int> removed_ids;
+        {
+            LOG_DURATION("fingerprints"s);
+            removed_ids = remove_duplicates(search_server);
+        }
+        cout << removed_ids.size() << " duplicates, "s << (removed_ids == expected_ids ? "same"s : "different"s) << endl;
+
+        SearchServer near_search_server = make_server(documents);
+        {
+            LOG_DURATION("MinHash 0.8"s);
+            removed_ids = remove_duplicates(near_search_server, 0.8);
+        }
+        cout << removed_ids.size() << " near duplicates"s << endl;
+    }
+
+    {
+        // every document is compared with all kept ones
+        const auto documents = generate_documents(1'000, 250);
+        for (const double min_similarity : { 0.5, 0.8, 0.9 }) {
+            SearchServer search_server = make_server(documents);
+            vector<int> expected_ids;
+            vector<const map<string_view, double>*> kept_documents;
+            for (const int id : search_server) {
+                const auto& word_freqs = search_server.GetWordFrequencies(id);
+                if (any_of(kept_documents.begin(), kept_documents.end(), [&](const auto* kept_word_freqs) {
+                        return get_similarity(*kept_word_freqs, word_freqs) >= min_similarity;
+                    })) {
+                    expected_ids.push_back(id);
+                }
+                else {
+                    kept_documents.push_back(&word_freqs);
+                }
+            }
+            const auto removed_ids = remove_duplicates(search_server, min_similarity);
+            vector<int> false_ids;
+            set_difference(removed_ids.begin(), removed_ids.end(), expected_ids.begin(), expected_ids.end(), back_inserter(false_ids));
+            cout << min_similarity << ": found "s << removed_ids.size() << " of "s << expected_ids.size()
+                << ", false "s << false_ids.size() << endl;
+        }
+    }
+    std::cout << "Test 22 is done!" << std::endl;
+}
+
+/* ------------------------- Test23 ------------------------- */
+void Test23()
+{
+    using namespace std;
+
+    std::cout << "Wait..." << std::endl;
+
+    mt19937 generator;
+
+    // words of the second half of dictionary are not in documents, so a part of queries finds nothing
+    const auto dictionary = GenerateDictionary(generator, 2000, 10);
+    const vector<string> document_dictionary(dictionary.begin(), dictionary.begin() + 1000);
+    const auto documents = GenerateQueries(generator, document_dictionary, 10'000, 70);
+    const auto queries = GenerateQueries(generator, dictionary, 20'000, 2);
+
+    SearchServer search_server(dictionary[0]);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+    }
+    const auto expected_count = count_if(queries.begin(), queries.end(),
+        [&](const string& query) { return search_server.FindTopDocuments(query).empty(); });
+
+    {
+        RequestQueue request_queue(search_server);
+        {
+            LOG_DURATION("4 threads"s);
+            vector<thread> threads;
+            for (size_t thread_index = 0; thread_index < 4; ++thread_index) {
+                threads.emplace_back([&, thread_index] {
+                    for (size_t i = thread_index; i < queries.size(); i += 4) {
+                        request_queue.AddFindRequest(queries[i]);
+                    }
+                });
+            }
+            for (thread& thread : threads) {
+                thread.join();
+            }
+        }
+        const auto statistics = request_queue.GetStatistics();
+        cout << statistics.request_count << " requests, "s << statistics.no_result_count << " without result, expected "s
+            << expected_count << ", rate "s << statistics.no_result_rate << endl;
+        cerr << statistics.queries_per_second << " qps"s << endl;
+    }
+
+    {
+        // a minute of buckets by a second, requests go every 100 ms for two minutes,
+        // the window is from 61 s to 120 s
+        RequestQueue::Clock::time_point now;
+        RequestQueue request_queue(search_server, 1min, 60, [&now] { return now; });
+        for (size_t i = 0; i < 1200; ++i) {
+            now += 100ms;
+            request_queue.AddFindRequest(queries[i]);
+        }
+        const auto statistics = request_queue.GetStatistics();
+        const auto expected_last_count = count_if(queries.begin() + 609, queries.begin() + 1200,
+            [&](const string& query) { return search_server.FindTopDocuments(query).empty(); });
+        cout << statistics.request_count << " requests in window, "s << statistics.no_result_count << " without result, expected "s
+            << expected_last_count << ", "s << statistics.queries_per_second << " qps"s << endl;
+    }
+    std::cout << "Test 23 is done!" << std::endl;
+}
+
+/* ------------------------- Test24 ------------------------- */
+void Test24()
+{
+    using namespace std;
+
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 100'000, 10);
+    const auto queries = GenerateQueries(generator, dictionary, 100'000, 10);
+    vector<string_view> query_words;
+    for (const string& query : queries) {
+        for (const string_view word : SplitIntoWords(query)) {
+            query_words.push_back(word);
+        }
+    }
+
+    set<string, less<>> word_set;
+    size_t first_count = GetAllocationCount();
+    for (const string& word : dictionary) {
+        word_set.insert(word);
+    }
+    cout << "std::set: "s << word_set.size() << " words, "s << GetAllocationCount() - first_count << " allocations"s << endl;
+
+    TermDictionary term_dictionary;
+    first_count = GetAllocationCount();
+    for (const string& word : dictionary) {
+        term_dictionary.Add(word);
+    }
+    cout << "TermDictionary: "s << term_dictionary.GetSize() << " words, "s << GetAllocationCount() - first_count << " allocations"s << endl;
+
+    size_t found_count = 0;
+    {
+        LOG_DURATION("std::set lookups"s);
+        for (const string_view word : query_words) {
+            found_count += word_set.count(word);
+        }
+    }
+    size_t dictionary_found_count = 0;
+    {
+        LOG_DURATION("TermDictionary lookups"s);
+        for (const string_view word : query_words) {
+            dictionary_found_count += term_dictionary.Find(word) != TermDictionary::NO_TERM;
+        }
+    }
+    cout << found_count << " of "s << query_words.size() << " found, "s << dictionary_found_count << " by TermDictionary"s << endl;
+    std::cout << "Test 24 is done!" << std::endl;
+}
+
+/* ------------------------- Test25 ------------------------- */
+void Test25()
+{
+    using namespace std;
+
+    std::cout << "Wait..." << std::endl;
+
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 100, 10);
+    const auto documents = GenerateQueries(generator, dictionary, 20'000, 30);
+    const string& stop_word = dictionary[0];
+
+    SearchServer search_server(stop_word);
+    search_server.SetPositionsEnabled(true);
+    vector<DocumentToAdd> bulk_documents;
+    for (size_t i = 0; i < documents.size() / 2; ++i) {
+        bulk_documents.push_back({ static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 } });
+    }
+    search_server.AddDocuments(bulk_documents);
+    for (size_t i = documents.size() / 2; i < documents.size(); ++i) {
+        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+    }
+    for (int id = 0; id < 20'000; id += 7) {
+        search_server.RemoveDocument(id);
+    }
+
+    // phrases of two or three words of some document, a word may be replaced by stop word
+    vector<vector<string_view>> phrases;
+    vector<string> queries;
+    for (int i = 0; i < 200; ++i) {
+        const vector<string_view> words = SplitIntoWords(documents[uniform_int_distribution<int>(0, documents.size() - 1)(generator)]);
+        const int length = uniform_int_distribution<int>(2, 3)(generator);
+        const int first = uniform_int_distribution<int>(0, words.size() - length)(generator);
+        vector<string_view> phrase(words.begin() + first, words.begin() + first + length);
+        if (length == 3 && i % 4 == 0) {
+            phrase[1] = stop_word;
+        }
+        string query = "\""s;
+        for (const string_view word : phrase) {
+            query.append(query.size() > 1 ? " "s : ""s).append(word);
+        }
+        queries.push_back(query + "\""s);
+        phrases.push_back(move(phrase));
+    }
+
+    // stop words match any word, but those at the ends of phrase are dropped, a phrase of stop words matches nothing
+    const auto has_phrase = [&](const string& text, vector<string_view> phrase) {
+        while (!phrase.empty() && phrase.back() == stop_word) {
+            phrase.pop_back();
+        }
+        while (!phrase.empty() && phrase.front() == stop_word) {
+            phrase.erase(phrase.begin());
+        }
+        if (phrase.empty()) {
+            return false;
+        }
+        const vector<string_view> words = SplitIntoWords(text);
+        for (size_t first = 0; first + phrase.size() <= words.size(); ++first) {
+            bool is_found = true;
+            for (size_t i = 0; i < phrase.size() && is_found; ++i) {
+                is_found = phrase[i] == stop_word || words[first + i] == phrase[i];
+            }
+            if (is_found) {
+                return true;
+            }
+        }
+        return false;
+    };
+    const auto check_phrases = [&](const string& name, const SearchServer& server) {
+        int matched_count = 0;
+        int mismatch_count = 0;
+        LOG_DURATION(name);
+        for (size_t i = 0; i < queries.size(); ++i) {
+            set<int> expected_ids;
+            for (const int id : server) {
+                if (has_phrase(documents[id], phrases[i])) {
+                    expected_ids.insert(id);
+                }
+            }
+            const auto found = server.FindTopDocuments(execution::seq, queries[i], DocumentStatus::ACTUAL, documents.size());
+            const auto found_par = server.FindTopDocuments(execution::par, queries[i], DocumentStatus::ACTUAL, documents.size());
+            set<int> found_ids;
+            for (const Document& document : found) {
+                found_ids.insert(document.id);
+            }
+            matched_count += found.size();
+            mismatch_count += found_ids != expected_ids || found.size() != found_par.size() ||
+                !equal(found.begin(), found.end(), found_par.begin(),
+                    [](const Document& lhs, const Document& rhs) { return lhs.id == rhs.id && abs(lhs.relevance - rhs.relevance) < MIN_REAL_VALUE; });
+        }
+        cout << name << ": "s << queries.size() << " phrases, "s << matched_count << " matched documents, "s << mismatch_count << " mismatches"s << endl;
+    };
+    check_phrases("phrases"s, search_server);
+
+    // documents with both words within distance are ranked higher than by plain words
+    const string lhs = dictionary[1];
+    const string rhs = dictionary[2];
+    const auto near_documents = search_server.FindTopDocuments(lhs + " NEAR/3 "s + rhs, DocumentStatus::ACTUAL);
+    const auto plain_documents = search_server.FindTopDocuments(lhs + " "s + rhs, DocumentStatus::ACTUAL);
+    cout << lhs << " NEAR/3 "s << rhs << ":"s;
+    for (const Document& document : near_documents) {
+        cout << " {"s << document.id << ", "s << document.relevance << "}"s;
+    }
+    cout << endl << lhs << " "s << rhs << ":"s;
+    for (const Document& document : plain_documents) {
+        cout << " {"s << document.id << ", "s << document.relevance << "}"s;
+    }
+    cout << endl;
+
+    SearchServer small_server("and in on"s);
+    small_server.SetPositionsEnabled(true);
+    small_server.AddDocument(1, "white cat and fancy collar and white cat on the mat"s, DocumentStatus::ACTUAL, { 1 });
+    for (const auto& match : small_server.MatchPhrases("\"white cat\" \"collar on white\" -dog"s, 1)) {
+        for (const string_view word : match.words) {
+            cout << word << ' ';
+        }
+        cout << "at"s;
+        for (const uint32_t position : match.positions) {
+            cout << ' ' << position;
+        }
+        cout << endl;
+    }
+    cout << get<0>(small_server.MatchDocument("\"cat white\" collar"s, 1)).size() << " words of \"cat white\" collar"s << endl;
+
+    const string path = "search_server.snapshot"s;
+    search_server.SaveSnapshot(path);
+    const SearchServer loaded_server = SearchServer::LoadSnapshot(path);
+    remove(path.c_str());
+    check_phrases("loaded phrases"s, loaded_server);
+
+    for (const string& query : { "\"white cat"s, "\"\""s, "\"white -cat\""s, "cat NEAR/0 dog"s, "cat NEAR/2"s, "-cat NEAR/2 dog"s }) {
+        try {
+            small_server.FindTopDocuments(query);
+        }
+        catch (const invalid_argument& e) {
+            cout << query << ": "s << e.what() << endl;
+        }
+    }
+    try {
+        SearchServer(""s).FindTopDocuments("\"white cat\""s);
+    }
+    catch (const invalid_argument& e) {
+        cout << "without positions: "s << e.what() << endl;
+    }
+    std::cout << "Test 25 is done!" << std::endl;
+}
+
+/* ------------------------- Test26 ------------------------- */
+void Test26()
+{
+    using namespace std;
+
+    std::cout << "Wait..." << std::endl;
+
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, 50'000, 70);
+
+    SearchServer search_server(dictionary[0]);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+    }
+    for (int id = 0; id < 50'000; id += 9) {
+        search_server.RemoveDocument(id);
+    }
+
+    // two of five words are required, some queries have a minus word
+    vector<string> queries;
+    vector<string> plain_queries;
+    for (int i = 0; i < 1'000; ++i) {
+        string query;
+        string plain_query;
+        for (int j = 0; j < 5; ++j) {
+            const string& word = dictionary[uniform_int_distribution<int>(0, dictionary.size() - 1)(generator)];
+            const string prefix = j < 2 ? "+"s : j == 4 && i % 3 == 0 ? "-"s : ""s;
+            query += prefix + word + " "s;
+            plain_query += (prefix == "-"s ? prefix : ""s) + word + " "s;
+        }
+        queries.push_back(query);
+        plain_queries.push_back(plain_query);
+    }
+
+    // documents of required words are the documents of plain query which have all of them, with the same relevance
+    int matched_count = 0;
+    int mismatch_count = 0;
+    for (size_t i = 0; i < queries.size(); ++i) {
+        vector<string_view> required_words;
+        for (const string_view word : SplitIntoWords(queries[i])) {
+            if (word[0] == '+' && word.substr(1) != dictionary[0]) {
+                required_words.push_back(word.substr(1));
+            }
+        }
+        vector<Document> expected;
+        for (const Document& document : search_server.FindTopDocuments(execution::seq, plain_queries[i], DocumentStatus::ACTUAL, documents.size())) {
+            const auto& word_freqs = search_server.GetWordFrequencies(document.id);
+            if (all_of(required_words.begin(), required_words.end(), [&word_freqs](string_view word) { return word_freqs.count(word) > 0; })) {
+                expected.push_back(document);
+            }
+        }
+        const auto found = search_server.FindTopDocuments(execution::seq, queries[i], DocumentStatus::ACTUAL, documents.size());
+        const auto found_par = search_server.FindTopDocuments(execution::par, queries[i], DocumentStatus::ACTUAL, documents.size());
+        const auto is_same = [](const Document& lhs, const Document& rhs) { return lhs.id == rhs.id && abs(lhs.relevance - rhs.relevance) < MIN_REAL_VALUE; };
+        matched_count += found.size();
+        mismatch_count += found.size() != expected.size() || !equal(found.begin(), found.end(), expected.begin(), is_same) ||
+            found_par.size() != expected.size() || !equal(found_par.begin(), found_par.end(), expected.begin(), is_same);
+    }
+    cout << queries.size() << " queries with required words, "s << matched_count << " matched documents, "s << mismatch_count << " mismatches"s << endl;
+
+    Test("plain words"s, search_server, plain_queries, execution::seq);
+    Test("required words"s, search_server, queries, execution::seq);
+    Test("required words par"s, search_server, queries, execution::par);
+
+    for (const string& query : { "+"s, "+-cat"s, "-+cat"s, "++cat"s }) {
+        try {
+            search_server.FindTopDocuments(query);
+        }
+        catch (const invalid_argument& e) {
+            cout << query << ": "s << e.what() << endl;
+        }
+    }
+    std::cout << "Test 26 is done!" << std::endl;
+}
+
+/* ------------------------- Test27 ------------------------- */
+void Test27()
+{
+    using namespace std;
+
+    std::cout << "Wait..." << std::endl;
+
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, 50'000, 70);
+
+    SearchServer search_server(dictionary[0]);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        search_server.AddDocument(i, documents[i], static_cast<DocumentStatus>(i % 4), { 1, 2, 3 });
+    }
+    for (int id = 0; id < 50'000; id += 9) {
+        search_server.RemoveDocument(id);
+    }
+    search_server.SetRetrievalMode(RetrievalMode::EXHAUSTIVE);
+
+    // every document has a few words of a small dictionary, so minus words exclude many of them
+    vector<string> queries;
+    for (int i = 0; i < 300; ++i) {
+        string query;
+        for (int j = 0; j < 10; ++j) {
+            query += (j >= 7 ? "-"s : ""s) + dictionary[uniform_int_distribution<int>(0, dictionary.size() - 1)(generator)] + " "s;
+        }
+        queries.push_back(query);
+    }
+
+    const auto predicate = []([[maybe_unused]] int document_id, DocumentStatus document_status, [[maybe_unused]] int rating) {
+        return document_status == DocumentStatus::BANNED;
+    };
+    const auto is_same = [](const Document& lhs, const Document& rhs) { return lhs.id == rhs.id && abs(lhs.relevance - rhs.relevance) < MIN_REAL_VALUE; };
+    // near ties may go in other order in parallel search, so documents are compared by id
+    const auto sort_by_id = [](vector<Document> documents) {
+        sort(documents.begin(), documents.end(), [](const Document& lhs, const Document& rhs) { return lhs.id < rhs.id; });
+        return documents;
+    };
+    int mismatch_count = 0;
+    for (const string& query : queries) {
+        const auto by_status = sort_by_id(search_server.FindTopDocuments(execution::seq, query, DocumentStatus::BANNED, documents.size()));
+        const auto by_status_par = sort_by_id(search_server.FindTopDocuments(execution::par, query, DocumentStatus::BANNED, documents.size()));
+        const auto by_predicate = sort_by_id(search_server.FindTopDocuments(execution::seq, query, predicate, documents.size()));
+        mismatch_count += by_status.size() != by_predicate.size() || !equal(by_status.begin(), by_status.end(), by_predicate.begin(), is_same) ||
+            by_status_par.size() != by_predicate.size() || !equal(by_status_par.begin(), by_status_par.end(), by_predicate.begin(), is_same);
+    }
+    cout << queries.size() << " queries with minus words, "s << mismatch_count << " mismatches of status bitset"s << endl;
+
+    size_t document_count = 0;
+    {
+        LOG_DURATION("status bitset"s);
+        for (const string& query : queries) {
+            document_count += search_server.FindTopDocuments(query, DocumentStatus::BANNED).size();
+        }
+    }
+    {
+        LOG_DURATION("predicate"s);
+        for (const string& query : queries) {
+            document_count += search_server.FindTopDocuments(query, predicate).size();
+        }
+    }
+    cout << document_count << endl;
+    std::cout << "Test 27 is done!" << std::endl;
+}
+
+/* ------------------------- Test28 ------------------------- */
+void Test28()
+{
+    using namespace std;
+    using Posting = InvertedIndex::Posting;
+
+    mt19937 generator;
+    const int document_count = 4000;
+    constexpr uint32_t max_term_count = numeric_limits<uint32_t>::max();
+
+    const auto random_postings = [&](size_t size) {
+        vector<int> ordinals(document_count);
+        iota(ordinals.begin(), ordinals.end(), 0);
+        shuffle(ordinals.begin(), ordinals.end(), generator);
+        ordinals.resize(size);
+        sort(ordinals.begin(), ordinals.end());
+        vector<Posting> postings;
+        for (const int ordinal : ordinals) {
+            postings.push_back({ ordinal, uniform_int_distribution<uint32_t>(1, 5)(generator) });
+        }
+        return postings;
+    };
+
+    // uncompressed lists: block edges, the widest gaps and term counts, every document, random ones
+    vector<pair<string, vector<Posting>>> lists = {
+        { "full block"s, random_postings(InvertedIndex::BLOCK_SIZE) },
+        { "block and one"s, random_postings(InvertedIndex::BLOCK_SIZE + 1) },
+        { "single"s, random_postings(1) },
+        { "last document"s, { { document_count - 1, max_term_count } } },
+        { "widest values"s, {} },
+        { "every document"s, {} },
+    };
+    for (int ordinal = 0; ordinal < document_count; ++ordinal) {
+        if (ordinal < 64 || ordinal >= document_count - 66) {
+            lists[4].second.push_back({ ordinal, ordinal % 2 == 0 ? max_term_count : 1 });
+        }
+        lists[5].second.push_back({ ordinal, 1 });
+    }
+    for (int i = 0; i < 20; ++i) {
+        lists.push_back({ "random "s + to_string(i), random_postings(uniform_int_distribution<int>(1, 1000)(generator)) });
+    }
+
+    InvertedIndex index;
+    vector<int> term_ids;
+    for (const auto& [name, postings] : lists) {
+        term_ids.push_back(index.AddTerm(name));
+    }
+    for (int ordinal = 0; ordinal < document_count; ++ordinal) {
+        index.SetDocumentLength(ordinal, 10);
+    }
+    for (size_t i = 0; i < lists.size(); ++i) {
+        for (const Posting& posting : lists[i].second) {
+            index.AddPosting(term_ids[i], posting.document_ordinal, posting.term_count);
+        }
+    }
+
+    // full blocks are bit-packed, in the buffer the last one is in varints, sealed lists pack it too
+    const auto check = [&](const string& mark) {
+        int decode_mismatch_count = 0;
+        int seek_mismatch_count = 0;
+        for (size_t i = 0; i < lists.size(); ++i) {
+            const vector<Posting>& expected = lists[i].second;
+            vector<Posting> decoded;
+            for (auto it = index.GetPostings(term_ids[i]); !it.IsEnd(); it.Next()) {
+                decoded.push_back({ it.GetOrdinal(), it.GetTermCount() });
+            }
+            const auto is_same = [](const Posting& lhs, const Posting& rhs) {
+                return lhs.document_ordinal == rhs.document_ordinal && lhs.term_count == rhs.term_count;
+            };
+            if (decoded.size() != expected.size() || !equal(decoded.begin(), decoded.end(), expected.begin(), is_same)) {
+                cout << mark << ": "s << lists[i].first << " is decoded wrong"s << endl;
+                ++decode_mismatch_count;
+            }
+
+            // Seek must land on the first posting not less than target, also when it is in the next block
+            const auto check_seek = [&](InvertedIndex::PostingIterator& it, int target) {
+                const auto lower = lower_bound(expected.begin(), expected.end(), target,
+                    [](const Posting& posting, int ordinal) { return posting.document_ordinal < ordinal; });
+                const bool is_found = it.Seek(target);
+                const bool is_right = lower == expected.end()
+                    ? it.IsEnd()
+                    : !it.IsEnd() && is_same({ it.GetOrdinal(), it.GetTermCount() }, *lower) && is_found == (lower->document_ordinal == target);
+                seek_mismatch_count += !is_right;
+            };
+            vector<int> targets = { 0, document_count - 1, document_count };
+            for (size_t edge = InvertedIndex::BLOCK_SIZE; edge <= expected.size(); edge += InvertedIndex::BLOCK_SIZE) {
+                for (const int ordinal : { expected[edge - 1].document_ordinal, expected[edge - 1].document_ordinal + 1 }) {
+                    targets.push_back(ordinal);
+                }
+                if (edge < expected.size()) {
+                    targets.push_back(expected[edge].document_ordinal);
+                }
+            }
+            for (const int target : targets) {
+                auto it = index.GetPostings(term_ids[i]);
+                check_seek(it, target);
+            }
+            auto it = index.GetPostings(term_ids[i]);
+            for (int target = 0; target <= document_count; target += uniform_int_distribution<int>(1, 200)(generator)) {
+                check_seek(it, target);
+            }
+        }
+        cout << mark << ": "s << lists.size() << " lists, "s << decode_mismatch_count << " decode mismatches, "s
+            << seek_mismatch_count << " seek mismatches"s << endl;
+    };
+    check("buffer"s);
+    index.Flush(true);
+    check("sealed"s);
+    std::cout << "Test 28 is done!" << std::endl;
+}
+
+/* ------------------------- Test29 ------------------------- */
+void Test29()
+{
+    using namespace std;
+
+    std::cout << "Wait..." << std::endl;
+
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 300, 10);
+    const auto texts = GenerateQueries(generator, dictionary, 2'000, 20);
+
+    // every text is added three times, twice with the same rating, so relevance ties are broken by rating and id
+    SearchServer search_server(dictionary[0]);
+    int document_id = 0;
+    for (const string& text : texts) {
+        const int rating = uniform_int_distribution<int>(-5, 5)(generator);
+        for (const int copy_rating : { rating, rating, rating + 1 }) {
+            search_server.AddDocument(document_id++, text, DocumentStatus::ACTUAL, { copy_rating });
+        }
+    }
+    const auto queries = GenerateQueries(generator, dictionary, 200, 5);
+    const size_t document_count = search_server.GetDocumentCount();
+
+    const auto is_same = [](const vector<Document>& lhs, const vector<Document>& rhs) {
+        return lhs.size() == rhs.size() && equal(lhs.begin(), lhs.end(), rhs.begin(),
+            [](const Document& lhs, const Document& rhs) { return lhs.id == rhs.id; });
+    };
+    // page is compared with the slice of all sorted documents, offsets go past the end too
+    const auto check_pages = [&](const string& mark, auto policy) {
+        int page_count = 0;
+        int mismatch_count = 0;
+        for (const string& query : queries) {
+            const auto all_documents = search_server.FindTopDocuments(policy, query, DocumentStatus::ACTUAL, document_count);
+            const size_t size = all_documents.size();
+            for (const size_t result_count : { size_t{ 0 }, size_t{ 1 }, size_t{ 5 }, size_t{ 7 }, size }) {
+                for (const size_t offset : { size_t{ 0 }, size_t{ 1 }, size_t{ 3 }, size_t{ 5 }, size / 2, size - min(size, size_t{ 1 }), size, size + 10 }) {
+                    const auto page = search_server.FindTopDocuments(policy, query, DocumentStatus::ACTUAL, result_count, offset);
+                    const auto first = all_documents.begin() + min(offset, size);
+                    const vector<Document> slice(first, first + min(result_count, static_cast<size_t>(all_documents.end() - first)));
+                    ++page_count;
+                    mismatch_count += !is_same(page, slice);
+                }
+            }
+        }
+        cout << mark << ": "s << page_count << " pages, "s << mismatch_count << " mismatches"s << endl;
+    };
+
+    for (const RetrievalMode mode : { RetrievalMode::EXHAUSTIVE, RetrievalMode::MAX_SCORE }) {
+        search_server.SetRetrievalMode(mode);
+        const string mark = mode == RetrievalMode::EXHAUSTIVE ? "exhaustive"s : "max score"s;
+        check_pages(mark, execution::seq);
+        check_pages(mark + " par"s, execution::par);
+    }
+    std::cout << "Test 29 is done!" << std::endl;
+}
+
+/* ------------------------- Test30 ------------------------- */
+void Test30()
+{
+    using namespace std;
+
+    std::cout << "Wait..." << std::endl;
+
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 300, 10);
+    const auto documents = GenerateQueries(generator, dictionary, 40'000, 20);
+    const int window_size = 3'000;
+    const int batch_size = 1'000;
+    const auto get_status = [](int id) { return static_cast<DocumentStatus>(id % 3); };
+
+    // the oldest documents are removed as new ones are added, so removed ones become the most
+    // and their ordinals are compacted again and again
+    SearchServer search_server(dictionary[0]);
+    search_server.SetPositionsEnabled(true);
+    for (int first = 0; first < static_cast<int>(documents.size()); first += batch_size) {
+        vector<DocumentToAdd> batch;
+        for (int id = first; id < first + batch_size; ++id) {
+            batch.push_back({ id, documents[id], get_status(id), { id % 7 } });
+        }
+        search_server.AddDocuments(batch);
+        vector<int> removed_ids;
+        for (int id = first + batch_size - window_size - batch_size; id < first + batch_size - window_size; ++id) {
+            removed_ids.push_back(id);
+        }
+        search_server.RemoveDocuments(removed_ids);
+    }
+
+    SearchServer fresh_search_server(dictionary[0]);
+    fresh_search_server.SetPositionsEnabled(true);
+    for (const int id : search_server) {
+        fresh_search_server.AddDocument(id, documents[id], get_status(id), { id % 7 });
+    }
+    cout << search_server.GetDocumentCount() << " documents, "s << fresh_search_server.GetDocumentCount() << " fresh"s << endl;
+
+    // plain queries and phrases of two words of present documents
+    vector<string> queries = GenerateQueries(generator, dictionary, 300, 5);
+    for (int i = 0; i < 100; ++i) {
+        const vector<string_view> words = SplitIntoWords(documents[documents.size() - 1 - uniform_int_distribution<int>(0, window_size - 1)(generator)]);
+        const size_t first = uniform_int_distribution<size_t>(0, words.size() - 2)(generator);
+        queries.push_back("\""s + string(words[first]) + " "s + string(words[first + 1]) + "\""s);
+    }
+    // segments of the servers differ, so relevances may differ in the last bits
+    const auto is_same = [](const Document& lhs, const Document& rhs) {
+        return lhs.id == rhs.id && abs(lhs.relevance - rhs.relevance) < MIN_REAL_VALUE && lhs.rating == rhs.rating;
+    };
+    int mismatch_count = 0;
+    for (const string& query : queries) {
+        for (const DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::BANNED }) {
+            const auto expected = fresh_search_server.FindTopDocuments(query, status);
+            const auto found = search_server.FindTopDocuments(query, status);
+            mismatch_count += found.size() != expected.size() || !equal(found.begin(), found.end(), expected.begin(), is_same);
+        }
+    }
+    cout << "compacted against fresh: "s << queries.size() << " queries, "s << mismatch_count << " mismatches"s << endl;
+    std::cout << "Test 30 is done!" << std::endl;
+}
+
+/* ------------------------- Test31 ------------------------- */
+void Test31()
+{
+    using namespace std;
+
+    std::cout << "Wait..." << std::endl;
+
+    // every version is updated by one document, words of the oldest documents are removed
+    // and come back later, so copies and removed words both grow the arena if it is not bounded
+    const int update_count = 5'000;
+    const int window_size = 100;
+    const int word_count = 20;
+    const int distinct_word_count = 30'000;
+    ConcurrentSearchServer search_server(SearchServer("and"s));
+    for (int id = 0; id < update_count; ++id) {
+        string text;
+        for (int i = 0; i < word_count; ++i) {
+            text += "word"s + to_string((id * word_count + i) % distinct_word_count) + " "s;
+        }
+        search_server.AddDocument(id, text, DocumentStatus::ACTUAL, { 1 });
+        if (id >= window_size) {
+            search_server.RemoveDocuments({ id - window_size });
+        }
+    }
+    const auto snapshot = search_server.GetSnapshot();
+    const size_t arena_size = snapshot->GetWordArenaSize();
+    cout << snapshot->GetDocumentCount() << " documents, arena of words: "s << arena_size / 1024 << " KiB, "s
+        << (arena_size <= 4 * 64 * 1024 ? "bounded"s : "not bounded"s) << endl;
+    // words of the last document are found through views into compacted arena
+    const int last_word = ((update_count - 1) * word_count + word_count - 1) % distinct_word_count;
+    const auto documents = snapshot->FindTopDocuments("word"s + to_string(last_word));
+    cout << "last word: "s << documents.size() << " document, id = "s << (documents.empty() ? -1 : documents[0].id) << endl;
+    std::cout << "Test 31 is done!" << std::endl;
+}
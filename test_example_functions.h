@@ -5,10 +5,13 @@
 #include <string>
 #include <vector>
 
+#include "allocation_counter.h"
+#include "concurrent_search_server.h"
 #include "paginator.h"
 #include "process_queries.h"
+#include "query_cache.h"
 #include "read_input_functions.h"
-//#include "remove_duplicates.h"
+#include "remove_duplicates.h"
 #include "request_queue.h"
 #include "search_server.h"
 
@@ -79,6 +82,8 @@ void Test(std::string_view mark, const SearchServer& search_server, const std::v
     cout << total_relevance << endl;
 }//*/
 
+void PrintLatencies(std::string_view mark, std::vector<double> latencies);
+
 void Test01(); // checking old search server
 void Test02(); // checking ProcessQueries with execution
 void Test03(); // + random7
@@ -90,4 +95,24 @@ void Test08(); // making parallel SearchServer::MatchDocument
 void Test09(); // + random
 void Test10(); // making parallel SearchServer::FindTopDocument
 void Test11(); // + random
+void Test12(); // MaxScore FindTopDocuments against exhaustive one
+void Test13(); // ProcessQueries thread pool latencies
+void Test14(); // QueryCache in front of SearchServer
+void Test15(); // bulk AddDocuments against AddDocument one by one
+void Test16(); // SearchServer snapshot save and load
+void Test17(); // SplitIntoWords throughput and invalid words
+void Test18(); // allocations of search with QueryContext
+void Test19(); // BM25 ranking against TF-IDF
+void Test20(); // query latencies during ingestion: global lock against ConcurrentSearchServer
+void Test21(); // segmented index: tombstones and merges of segments
+void Test22(); // RemoveDuplicates by fingerprints and MinHash LSH against exhaustive ones
+void Test23(); // RequestQueue time window with concurrent callers
+void Test24(); // TermDictionary against std::set of words
+void Test25(); // phrase and NEAR queries by positions of words against brute force
+void Test26(); // +required words by intersection of posting lists against plain queries
+void Test27(); // minus words and status filtered by bitsets before scoring
+void Test28(); // bit-packed blocks of posting lists decode to the uncompressed lists
+void Test29(); // pages of FindTopDocuments against slices of all found documents
+void Test30(); // search after compaction of ordinals of removed documents against fresh server
+void Test31(); // arena of words stays bounded under single-document read-copy-update versions
 
@@ -0,0 +1,115 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+namespace {
+    thread_local const ThreadPool* current_pool = nullptr;
+    thread_local size_t current_worker = 0;
+}
+
+ThreadPool::ThreadPool(size_t thread_count) {
+    thread_count = std::max<size_t>(thread_count, 1);
+    for (size_t i = 0; i < thread_count; ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < thread_count; ++i) {
+        threads_.emplace_back([this, i] { RunWorker(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard guard(wake_mutex_);
+        is_stopped_ = true;
+    }
+    wake_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+ThreadPool& ThreadPool::GetDefault() {
+    static ThreadPool pool;
+    return pool;
+}
+
+size_t ThreadPool::GetThreadCount() const {
+    return workers_.size();
+}
+
+void ThreadPool::Push(std::function<void()> task) {
+    // own tasks go to own deque, foreign threads spread them round robin
+    size_t index = GetCurrentWorker();
+    if (index == workers_.size()) {
+        index = next_worker_++ % workers_.size();
+    }
+    // counted before it becomes visible, so the counter never goes below zero
+    bool has_waiting = false;
+    {
+        std::lock_guard guard(wake_mutex_);
+        ++queued_count_;
+        has_waiting = waiting_count_ > 0;
+    }
+    {
+        std::lock_guard guard(workers_[index]->mutex);
+        workers_[index]->tasks.push_back(std::move(task));
+    }
+    wake_.notify_one();
+    if (has_waiting) {
+        progress_.notify_all();
+    }
+}
+
+bool ThreadPool::TryRunTask() {
+    const size_t own = GetCurrentWorker();
+    std::function<void()> task;
+    if (own < workers_.size()) {
+        std::lock_guard guard(workers_[own]->mutex);
+        if (!workers_[own]->tasks.empty()) {
+            task = std::move(workers_[own]->tasks.back());
+            workers_[own]->tasks.pop_back();
+        }
+    }
+    const size_t start = own < workers_.size() ? own + 1 : next_worker_.load();
+    for (size_t i = 0; !task && i < workers_.size(); ++i) {
+        Worker& victim = *workers_[(start + i) % workers_.size()];
+        std::lock_guard guard(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+        }
+    }
+    if (!task) {
+        return false;
+    }
+    --queued_count_;
+    task();
+    {
+        std::lock_guard guard(wake_mutex_);
+        ++finished_count_;
+        if (waiting_count_ == 0) {
+            return true;
+        }
+    }
+    progress_.notify_all();
+    return true;
+}
+
+void ThreadPool::RunWorker(size_t index) {
+    current_pool = this;
+    current_worker = index;
+    while (true) {
+        if (TryRunTask()) {
+            continue;
+        }
+        std::unique_lock lock(wake_mutex_);
+        wake_.wait(lock, [this] { return is_stopped_ || queued_count_ > 0; });
+        if (is_stopped_ && queued_count_ == 0) {
+            return;
+        }
+    }
+}
+
+size_t ThreadPool::GetCurrentWorker() const {
+    return current_pool == this ? current_worker : workers_.size();
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Work-stealing executor: every worker has its own deque, takes tasks from its back
+// and steals from the front of others. A thread waiting for its tasks runs queued tasks
+// meanwhile, so nested ParallelFor/Submit from a worker don't oversubscribe or deadlock.
+// When there is nothing to run it spins a little and then sleeps until a task is finished or pushed.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t thread_count = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // pool used by ProcessQueries and parallel SearchServer methods
+    static ThreadPool& GetDefault();
+
+    size_t GetThreadCount() const;
+
+    template <typename Function>
+    std::future<std::invoke_result_t<Function>> Submit(Function function);
+
+    // calls function(i) for every i in [first, last) and waits, the calling thread takes part
+    template <typename Function>
+    void ParallelFor(size_t first, size_t last, Function function);
+
+    // waits for future running queued tasks instead of blocking
+    template <typename T>
+    T Wait(std::future<T>& future);
+
+private:
+    // yields of waiting thread without tasks to run before it sleeps
+    static constexpr size_t WAIT_SPIN_COUNT = 64;
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
+    std::atomic<size_t> queued_count_ = 0;
+    std::atomic<size_t> next_worker_ = 0;
+    bool is_stopped_ = false;
+    // threads sleeping in WaitUntil, they are woken by finished and pushed tasks, both are guarded by wake_mutex_
+    std::condition_variable progress_;
+    size_t finished_count_ = 0;
+    size_t waiting_count_ = 0;
+
+    void Push(std::function<void()> task);
+    // runs one task from own deque or stolen one, false if all deques are empty
+    bool TryRunTask();
+    void RunWorker(size_t index);
+    // index of the calling thread in this pool or workers_.size() for foreign threads
+    size_t GetCurrentWorker() const;
+    // runs queued tasks until is_ready() is true
+    template <typename Ready>
+    void WaitUntil(Ready is_ready);
+};
+
+template <typename Function>
+std::future<std::invoke_result_t<Function>> ThreadPool::Submit(Function function) {
+    using Result = std::invoke_result_t<Function>;
+    auto task = std::make_shared<std::packaged_task<Result()>>(std::move(function));
+    std::future<Result> result = task->get_future();
+    Push([task] { (*task)(); });
+    return result;
+}
+
+template <typename Function>
+void ThreadPool::ParallelFor(size_t first, size_t last, Function function) {
+    if (first >= last) {
+        return;
+    }
+    // indices are taken one by one from the shared counter, so costly ones don't stall the rest
+    std::atomic<size_t> next_index = first;
+    std::atomic<size_t> finished_helpers = 0;
+    std::exception_ptr exception;
+    std::mutex exception_mutex;
+    auto run = [&] {
+        try {
+            for (size_t i = next_index++; i < last; i = next_index++) {
+                function(i);
+            }
+        }
+        catch (...) {
+            std::lock_guard guard(exception_mutex);
+            if (!exception) {
+                exception = std::current_exception();
+            }
+            next_index = last;
+        }
+    };
+
+    const size_t helper_count = std::min(last - first - 1, workers_.size());
+    for (size_t i = 0; i < helper_count; ++i) {
+        Push([&run, &finished_helpers] {
+            run();
+            ++finished_helpers;
+        });
+    }
+    run();
+    WaitUntil([&finished_helpers, helper_count] { return finished_helpers == helper_count; });
+    if (exception) {
+        std::rethrow_exception(exception);
+    }
+}
+
+template <typename T>
+T ThreadPool::Wait(std::future<T>& future) {
+    WaitUntil([&future] { return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready; });
+    return future.get();
+}
+
+template <typename Ready>
+void ThreadPool::WaitUntil(Ready is_ready) {
+    size_t idle_count = 0;
+    while (!is_ready()) {
+        if (TryRunTask()) {
+            idle_count = 0;
+            continue;
+        }
+        // tasks it waits for are running on other threads
+        if (++idle_count <= WAIT_SPIN_COUNT) {
+            std::this_thread::yield();
+            continue;
+        }
+        // readiness is checked under the lock, so a task finished after the check notifies this thread
+        std::unique_lock lock(wake_mutex_);
+        const size_t finished_count = finished_count_;
+        ++waiting_count_;
+        progress_.wait(lock, [&] { return is_ready() || queued_count_ > 0 || finished_count_ != finished_count; });
+        --waiting_count_;
+    }
+}
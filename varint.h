@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// unsigned values by 7 bits, low bits first, high bit of byte is set if more bytes follow
+
+inline void WriteVarint(std::vector<uint8_t>& data, uint32_t value) {
+    while (value >= 0x80) {
+        data.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    data.push_back(static_cast<uint8_t>(value));
+}
+
+// data must hold the whole value, it is moved past it
+inline uint32_t ReadVarint(const uint8_t*& data) {
+    uint32_t value = *data++;
+    // gaps and term counts usually fit in one byte
+    if (value < 0x80) {
+        return value;
+    }
+    value &= 0x7f;
+    for (int shift = 7;; shift += 7) {
+        const uint32_t byte = *data++;
+        value |= (byte & 0x7f) << shift;
+        if (byte < 0x80) {
+            return value;
+        }
+    }
+}
+
+// for data that is not trusted, false if value doesn't end before end or doesn't fit in 32 bits
+inline bool ReadVarint(const uint8_t*& data, const uint8_t* end, uint32_t& value) {
+    value = 0;
+    for (int shift = 0; (data < end) && (shift < 32); shift += 7) {
+        const uint32_t byte = *data++;
+        if ((shift == 28) && (byte > 0x0f)) {
+            return false;
+        }
+        value |= (byte & 0x7f) << shift;
+        if (byte < 0x80) {
+            return true;
+        }
+    }
+    return false;
+}